@@ -0,0 +1,208 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Monotonic arena, which hands out memory by bumping a pointer and releases it
+all at once.
+
+This is useful for objects that live as long as, say, one request.
+Deallocating memory one object at a time is a no-op; instead, the arena can be
+rewound to a checkpoint, or released as a whole.
+*/
+
+#ifndef UTILITY_ARENA_HPP_INCLUDED
+#define UTILITY_ARENA_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace utility {
+
+    /**
+    Monotonic arena.
+    Memory is allocated from the system in chunks, which double in size, up to
+    a limit.
+    This is not thread-safe.
+    Objects in the arena are not destructed by the arena.
+    */
+    class arena {
+        /// Header at the start of each chunk.
+        struct chunk {
+            chunk * previous;
+            std::size_t size;
+        };
+
+        static constexpr std::size_t max_chunk_size = 1024 * 1024;
+
+        chunk * current_;
+        char * position_;
+        char * end_;
+        std::size_t next_chunk_size_;
+
+        static char * memory_of (chunk * c) noexcept
+        { return reinterpret_cast <char *> (c + 1); }
+
+        /**
+        Allocate a new chunk with space for at least \a size bytes with
+        \a alignment.
+        */
+        void add_chunk (std::size_t size, std::size_t alignment) {
+            std::size_t chunk_size = next_chunk_size_;
+            while (chunk_size < size + alignment)
+                chunk_size *= 2;
+            chunk * c = static_cast <chunk *> (
+                ::operator new (sizeof (chunk) + chunk_size));
+            c->previous = current_;
+            c->size = chunk_size;
+            current_ = c;
+            position_ = memory_of (c);
+            end_ = position_ + chunk_size;
+            if (next_chunk_size_ < max_chunk_size)
+                next_chunk_size_ *= 2;
+        }
+
+        /// Free the current chunk and make the previous one current.
+        void free_chunk() noexcept {
+            chunk * previous = current_->previous;
+            ::operator delete (current_);
+            current_ = previous;
+        }
+
+        static char * align (char * position, std::size_t alignment) noexcept
+        {
+            return reinterpret_cast <char *> (
+                (reinterpret_cast <std::uintptr_t> (position) + alignment - 1)
+                & ~std::uintptr_t (alignment - 1));
+        }
+
+    public:
+        /**
+        Position in the arena, that the arena can be rewound to.
+        */
+        class position {
+            friend class arena;
+            chunk * chunk_;
+            char * position_;
+
+            position (chunk * c, char * p) noexcept
+            : chunk_ (c), position_ (p) {}
+        };
+
+        /**
+        Construct an empty arena.
+        \param initial_chunk_size
+            The size of the first chunk.
+            Later chunks are larger.
+        */
+        explicit arena (std::size_t initial_chunk_size = 4096) noexcept
+        : current_ (nullptr), position_ (nullptr), end_ (nullptr),
+            next_chunk_size_ (initial_chunk_size ? initial_chunk_size : 1) {}
+
+        arena (arena const &) = delete;
+        arena & operator = (arena const &) = delete;
+
+        /**
+        Release all memory.
+        */
+        ~arena() noexcept { release(); }
+
+        /**
+        \return Memory for \a size bytes, aligned to \a alignment, which must be
+        a power of two.
+        \throw std::bad_alloc If no new chunk can be allocated.
+        */
+        void * allocate (std::size_t size,
+            std::size_t alignment = alignof (std::max_align_t))
+        {
+            char * result = align (position_, alignment);
+            if (!current_ || result > end_
+                || std::size_t (end_ - result) < size)
+            {
+                add_chunk (size, alignment);
+                result = align (position_, alignment);
+            }
+            position_ = result + size;
+            return result;
+        }
+
+        /**
+        \return The current position, which rewind() can return to.
+        */
+        position checkpoint() const noexcept
+        { return position (current_, position_); }
+
+        /**
+        Make all memory that has been allocated since \a p was returned by
+        checkpoint() available again.
+        Chunks that were allocated since then are released.
+        Objects in that memory are not destructed.
+        */
+        void rewind (position const & p) noexcept {
+            while (current_ != p.chunk_)
+                free_chunk();
+            position_ = p.position_;
+            end_ = current_ ? memory_of (current_) + current_->size : nullptr;
+        }
+
+        /**
+        Release all memory.
+        Objects in the arena are not destructed.
+        */
+        void release() noexcept { rewind (position (nullptr, nullptr)); }
+    };
+
+    /**
+    Allocator that allocates from an arena.
+    deallocate() does nothing: the memory is released with the arena.
+    The allocator holds a pointer to the arena.
+    */
+    template <class Type> class arena_allocator {
+        template <class Other> friend class arena_allocator;
+        arena * arena_;
+
+    public:
+        typedef Type value_type;
+
+        explicit arena_allocator (arena & a) noexcept : arena_ (&a) {}
+
+        template <class Other>
+            arena_allocator (arena_allocator <Other> const & that) noexcept
+        : arena_ (that.arena_) {}
+
+        Type * allocate (std::size_t n) {
+            return static_cast <Type *> (
+                arena_->allocate (n * sizeof (Type), alignof (Type)));
+        }
+
+        void deallocate (Type *, std::size_t) noexcept {}
+
+        arena & get_arena() const noexcept { return *arena_; }
+    };
+
+    template <class Type1, class Type2>
+        inline bool operator == (arena_allocator <Type1> const & one,
+            arena_allocator <Type2> const & other) noexcept
+    { return &one.get_arena() == &other.get_arena(); }
+
+    template <class Type1, class Type2>
+        inline bool operator != (arena_allocator <Type1> const & one,
+            arena_allocator <Type2> const & other) noexcept
+    { return !(one == other); }
+
+} // namespace utility
+
+#endif // UTILITY_ARENA_HPP_INCLUDED
@@ -22,38 +22,13 @@ limitations under the License.
 #include <type_traits>
 
 #include "storage.hpp"
+#include "memory_for.hpp"
 #include "disable_if_same.hpp"
 
 namespace utility {
 
     namespace assignable_detail {
 
-        /**
-        Keep memory to keep an object, that allows sizeof, but do not initialise
-        the memory.
-        */
-        template <class Content> class memory_for {
-        public:
-            typedef typename std::aligned_storage <
-                sizeof (Content), alignof (Content)>::type memory_type;
-
-        private:
-            memory_type memory_;
-
-        public:
-            void * memory()
-            { return reinterpret_cast <void *> (&this->memory_); }
-
-            void const * memory() const
-            { return reinterpret_cast <void const *> (&this->memory_); }
-
-            Content * object()
-            { return reinterpret_cast <Content *> (memory()); }
-
-            Content const * object() const
-            { return reinterpret_cast <Content const *> (memory()); }
-        };
-
         /**
         Keep memory for an object and a flag to say whether it is constructed.
         The memory must be initialised explicitly, and the flag must be set
@@ -0,0 +1,218 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef UTILITY_ATOMIC_SMALL_PTR_HPP_INCLUDED
+#define UTILITY_ATOMIC_SMALL_PTR_HPP_INCLUDED
+
+#include <memory>
+#include <atomic>
+
+#include "small_ptr.hpp"
+#include "hazard_pointer.hpp"
+
+namespace utility {
+
+    /**
+    Owner of an object, like small_ptr, which can be loaded and stored by many
+    threads at the same time.
+    This is useful to publish snapshots of data that many threads read.
+
+    Loading a plain pointer and then acquiring a reference to the object would
+    race with another thread that replaces the pointer and releases the last
+    reference.
+    Therefore, load() protects the pointer with a hazard pointer until it has
+    acquired a reference.
+    When the pointer is replaced, the reference that this held is not released
+    immediately, but retired, and released only when no hazard pointer refers
+    to the object.
+    Retired references are kept per thread, and released when there are many,
+    when reclaim() is called, or when the thread exits.
+
+    All operations are lock-free if std::atomic <Type *> is, which is the case
+    on all common platforms.
+    The first operation in a thread may allocate memory for its hazard pointer.
+
+    \tparam Type The type of the object, which must work with small_ptr.
+    \tparam Allocator The allocator, which small_ptr uses.
+    */
+    template <class Type, class Allocator = std::allocator <Type>>
+        class atomic_small_ptr
+    {
+    public:
+        typedef Type value_type;
+        typedef small_ptr <Type, Allocator> strong_type;
+
+    private:
+        std::atomic <Type *> pointer_;
+        Allocator allocator_;
+
+        typedef hazard_pointer::retired_list <strong_type> retired_list;
+
+        /**
+        Acquire the reference that this will hold to the object that \a object
+        owns.
+        */
+        static void hold (strong_type const & object) noexcept {
+            if (object)
+                pointer_policy::shared_count::acquire (object.get());
+        }
+
+        /**
+        \return A new reference to \a object, which is passed on to the
+        caller.
+        */
+        strong_type acquire (Type * object) const {
+            if (object)
+                pointer_policy::shared_count::acquire (object);
+            return adopt (object);
+        }
+
+        strong_type adopt (Type * object) const {
+            return strong_type (
+                pointer_policy::adopt_reference(), object, allocator_);
+        }
+
+        /**
+        Release a reference to \a object straight away.
+        */
+        void release (Type * object) const { adopt (object); }
+
+        /**
+        Retire the reference that this held to \a object.
+        */
+        void retire (Type * object) const {
+            if (object)
+                retired_list::current().retire (adopt (object));
+        }
+
+    public:
+        /**
+        Construct empty.
+        */
+        explicit atomic_small_ptr (Allocator const & allocator = Allocator())
+        : pointer_ (nullptr), allocator_ (allocator) {}
+
+        /**
+        Construct with a reference to the object that \a object owns.
+        */
+        explicit atomic_small_ptr (strong_type const & object)
+        : pointer_ (object.get()), allocator_ (object.allocator())
+        { hold (object); }
+
+        atomic_small_ptr (atomic_small_ptr const &) = delete;
+        atomic_small_ptr & operator = (atomic_small_ptr const &) = delete;
+
+        /**
+        Release the reference that this holds.
+        No other thread may use this at the same time.
+        */
+        ~atomic_small_ptr() noexcept {
+            release (pointer_.load (std::memory_order_relaxed));
+        }
+
+        bool is_lock_free() const noexcept
+        { return pointer_.is_lock_free(); }
+
+        /**
+        \return A pointer that owns the object that this currently refers to.
+        */
+        strong_type load() const {
+            Type * object = hazard_pointer::protect (pointer_);
+            // The object cannot be destructed now.
+            strong_type result = acquire (object);
+            hazard_pointer::clear();
+            return result;
+        }
+
+        /**
+        Replace the object that this refers to by \a desired.
+        */
+        void store (strong_type const & desired) { exchange (desired); }
+
+        /**
+        Replace the object that this refers to by \a desired.
+        \return A pointer that owns the object that this referred to before.
+        */
+        strong_type exchange (strong_type const & desired) {
+            Type * new_object = desired.get();
+            hold (desired);
+            Type * old_object = pointer_.exchange (
+                new_object, std::memory_order_seq_cst);
+            // Another thread may be loading the old object, so take a new
+            // reference for the caller and retire the one this had.
+            strong_type result = acquire (old_object);
+            retire (old_object);
+            return result;
+        }
+
+        /**
+        If this refers to the same object as \a expected, replace it by
+        \a desired.
+        Otherwise, set \a expected to the object that the failed exchange
+        found.
+        Since \a expected holds a reference, its object cannot be reused while
+        this compares it, so the ABA problem does not occur.
+
+        The object that the failed exchange found may be replaced and
+        released before a reference to it can be acquired.
+        It is therefore protected with a hazard pointer, and if this does not
+        refer to it any more, the exchange is tried again.
+        \return true iff this was replaced.
+        */
+        bool compare_exchange_strong (
+            strong_type & expected, strong_type const & desired)
+        {
+            Type * new_object = desired.get();
+            hold (desired);
+            while (true) {
+                Type * found = expected.get();
+                if (pointer_.compare_exchange_strong (found, new_object,
+                        std::memory_order_seq_cst))
+                {
+                    retire (found);
+                    return true;
+                }
+                if (hazard_pointer::try_protect (pointer_, found)) {
+                    // The object cannot be destructed now.
+                    strong_type result = acquire (found);
+                    hazard_pointer::clear();
+                    // Release the reference that was meant for this.
+                    release (new_object);
+                    expected = std::move (result);
+                    return false;
+                }
+                hazard_pointer::clear();
+            }
+        }
+
+        /**
+        Like compare_exchange_strong.
+        This never fails spuriously.
+        */
+        bool compare_exchange_weak (
+            strong_type & expected, strong_type const & desired)
+        { return compare_exchange_strong (expected, desired); }
+
+        /**
+        Release the references that the current thread has retired, for all
+        objects of this type, as far as no other thread is loading them.
+        */
+        static void reclaim() { retired_list::current().reclaim(); }
+    };
+
+} // namespace utility
+
+#endif // UTILITY_ATOMIC_SMALL_PTR_HPP_INCLUDED
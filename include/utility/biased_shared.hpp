@@ -0,0 +1,536 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef UTILITY_BIASED_SHARED_HPP_INCLUDED
+#define UTILITY_BIASED_SHARED_HPP_INCLUDED
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "config.hpp"
+
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+#include "shared_instrumentation.hpp"
+#endif
+
+namespace utility {
+
+    class biased_shared;
+
+    namespace biased_shared_detail {
+
+        /**
+        Reference to an object that a thread other than its owner has released
+        before the counts were merged.
+        The owner thread merges the counts and then releases the reference.
+        */
+        class queued_reference {
+        public:
+            explicit queued_reference (biased_shared * object) noexcept
+            : object (object), next (nullptr) {}
+
+            virtual ~queued_reference() noexcept {}
+
+            /**
+            Release the reference, after the counts have been merged.
+            */
+            virtual void release() noexcept = 0;
+
+            biased_shared * object;
+            queued_reference * next;
+        };
+
+        /**
+        Queue of references that other threads have handed back to an owner
+        thread.
+        Each thread that owns objects has one of these.
+        It is registered with the registry for as long as the thread lives, so
+        that other threads can find it.
+        The registry links the queues through their "next_queue" members, so
+        registering cannot fail.
+        */
+        class owner_queue {
+        public:
+            inline owner_queue() noexcept;
+            inline ~owner_queue() noexcept;
+
+            /// Merge and release all queued references.
+            inline void process() noexcept;
+
+            /// Queue \a reference. Must be called with the registry locked.
+            void push (queued_reference * reference) noexcept {
+                reference->next = first;
+                first = reference;
+                has_queued.store (true, std::memory_order_release);
+            }
+
+            /**
+            Non-zero identifier for the owner thread.
+            This is unique for the life of the program, unlike std::thread::id.
+            */
+            std::uint64_t id;
+            std::atomic <bool> has_queued;
+
+            /// The next queue in the registry.
+            owner_queue * next_queue;
+
+        private:
+            queued_reference * first;
+        };
+
+        /**
+        Lock that spins, and yields while it waits.
+        Unlike std::mutex, locking it cannot throw.
+        It meets the requirements of std::lock_guard.
+        */
+        class spin_lock {
+            std::atomic <bool> locked;
+
+        public:
+            constexpr spin_lock() noexcept : locked (false) {}
+
+            void lock() noexcept {
+                while (locked.exchange (true, std::memory_order_acquire))
+                    std::this_thread::yield();
+            }
+
+            void unlock() noexcept
+            { locked.store (false, std::memory_order_release); }
+        };
+
+        /**
+        List of the queues of all owner threads that are alive.
+        This is only used on slow paths, so it is protected by a lock, and
+        queues are found by walking the list.
+        */
+        struct registry {
+            spin_lock mutex;
+            owner_queue * first_queue;
+            std::atomic <std::uint64_t> last_id;
+
+            constexpr registry() noexcept : first_queue (nullptr), last_id (0)
+            {}
+
+            static registry & get() noexcept {
+                static registry instance;
+                return instance;
+            }
+
+            /**
+            \return The queue for the owner thread with identifier \a id, or
+            nullptr if it has exited.
+            Must be called with the registry locked.
+            */
+            owner_queue * find (std::uint64_t id) const noexcept {
+                owner_queue * queue = first_queue;
+                while (queue && queue->id != id)
+                    queue = queue->next_queue;
+                return queue;
+            }
+        };
+
+        /**
+        \return The identifier of the current thread, or 0 if this thread has
+        never owned a biased_shared object.
+        This is cheap: it is a plain thread-local variable.
+        */
+        inline std::uint64_t & current_id() noexcept {
+            static thread_local std::uint64_t id = 0;
+            return id;
+        }
+
+        /**
+        \return A reference to whether the queue for the current thread has
+        been destructed.
+        This is trivially destructible, so it can be read after that, for
+        example from the destructors of other thread_local objects.
+        Then, the current thread does not take ownership of objects any more.
+        */
+        inline bool & queue_destroyed() noexcept {
+            static thread_local bool destroyed = false;
+            return destroyed;
+        }
+
+        /**
+        \return The queue for the current thread, which is constructed on first
+        use.
+        \pre queue_destroyed() is false.
+        */
+        inline owner_queue & current_queue() noexcept {
+            static thread_local owner_queue queue;
+            return queue;
+        }
+
+    } // namespace biased_shared_detail
+
+    /**
+    Base class for reference-counted objects that are mostly used by one
+    thread, but are sometimes shared with other threads.
+    This can be used with small_ptr instead of utility::shared.
+
+    The thread that first acquires a reference to the object becomes its owner.
+    The reference count is split in two.
+    The owner thread uses a "biased" count, which it changes without atomic
+    read-modify-write operations.
+    All other threads use a "shared" count, which is atomic.
+    Only the sum of the two counts is meaningful.
+
+    When the biased count drops to zero, the owner "merges" the counts: it adds
+    the biased count to the shared count and marks the object as merged, in one
+    atomic operation.
+    From then on, all threads, including the owner, use the shared count, and
+    the object is destructed when it reaches zero.
+
+    A reference that the owner acquired may be released by another thread.
+    The biased count then never drops to zero on its own.
+    Therefore, the first time another thread releases a reference before the
+    counts have been merged, it does not release it, but hands it back to the
+    owner thread.
+    The owner merges the counts and releases the reference when it next
+    acquires its first reference to an object, when its biased count for an
+    object drops to zero, when it calls merge_queued(), or when it exits.
+    The owner can therefore end up destructing objects at those points.
+    If the owner thread has already exited, the other thread merges the counts
+    itself.
+    If the other thread cannot allocate memory to hand the reference back, the
+    object is never destructed, rather than the program being terminated.
+
+    A thread whose queue has been destructed, which happens at thread exit,
+    does not become the owner of objects.
+    Objects that it acquires first use only the shared count.
+
+    The shared count and the flags are kept in one atomic integer, as
+    <c>4 * count + 2 * queued + merged</c>, so that they can be changed
+    together.
+    */
+    class biased_shared {
+    private:
+        std::uint64_t owner;
+        std::atomic <long> biased_count;
+        std::atomic <long> shared_word;
+
+        /// Value of "owner" for objects that never have an owner thread.
+        static constexpr std::uint64_t no_owner = ~std::uint64_t (0);
+
+        static constexpr long merged_flag = 1;
+        static constexpr long queued_flag = 2;
+        static constexpr long count_unit = 4;
+
+        // Once the queued flag is set, the shared count can become negative.
+        // The flags are then still the lowest bits, and the count must be
+        // rounded down, not towards zero.
+        static_assert ((-1l & (count_unit - 1)) == count_unit - 1,
+            "Signed integers must be two's complement.");
+
+        static long flags_of (long word) noexcept
+        { return word & (count_unit - 1); }
+        static long count_of (long word) noexcept
+        { return (word - flags_of (word)) / count_unit; }
+        static bool is_merged (long word) noexcept
+        { return flags_of (word) & merged_flag; }
+        static bool is_queued (long word) noexcept
+        { return flags_of (word) & queued_flag; }
+
+    protected:
+        biased_shared() noexcept
+        : owner (0), biased_count (0l), shared_word (0l) {}
+
+        // The copy and move constructors mustn't copy the count.
+        biased_shared (biased_shared const &) noexcept
+        : owner (0), biased_count (0l), shared_word (0l) {}
+        biased_shared (biased_shared &&) noexcept
+        : owner (0), biased_count (0l), shared_word (0l) {}
+
+        // Assignment mustn't copy the count.
+        biased_shared & operator = (biased_shared const &) noexcept
+        { return *this; }
+        biased_shared & operator = (biased_shared &&) noexcept
+        { return *this; }
+
+    private:
+        /**
+        \return true iff the current thread should use the biased count.
+        Only the owner can set the merged flag while it is alive, so it can
+        read the flag without synchronisation.
+        */
+        bool use_biased() const noexcept {
+            return owner == biased_shared_detail::current_id()
+                && !is_merged (shared_word.load (std::memory_order_relaxed));
+        }
+
+        /**
+        Merge the biased count into the shared count.
+        This must be called by the owner, or by another thread after the owner
+        has exited.
+        \return The merged count.
+        */
+        long merge() noexcept {
+            long biased = biased_count.load (std::memory_order_relaxed);
+            biased_count.store (0, std::memory_order_relaxed);
+            // This releases this thread's accesses to the object, and
+            // acquires those of threads that have released their references.
+            long previous = shared_word.fetch_add (
+                biased * count_unit + merged_flag, std::memory_order_acq_rel);
+            return count_of (previous) + biased;
+        }
+
+        /**
+        Release a reference through the shared count.
+        \return true iff this was the last reference.
+        */
+        static bool release_shared (biased_shared * s) noexcept {
+            long previous = s->shared_word.fetch_sub (
+                count_unit, UTILITY_CONFIG_RELEASE_COUNT_ORDER);
+            if (is_merged (previous) && count_of (previous) == 1) {
+                std::atomic_thread_fence (std::memory_order_acquire);
+                return true;
+            }
+            return false;
+        }
+
+        /**
+        Release a reference from a thread that is not the owner, before the
+        counts have been merged.
+        \return true iff the reference should now be released through the
+        shared count; false iff it has been handed to the owner.
+        */
+        template <class Storage>
+            static bool hand_back (biased_shared * s, Storage const & storage)
+            noexcept;
+
+        static void process_queue (biased_shared_detail::owner_queue & queue)
+            noexcept
+        {
+            if (queue.has_queued.load (std::memory_order_relaxed))
+                queue.process();
+        }
+
+        friend class biased_shared_detail::owner_queue;
+
+    public:
+        /**
+        Register as an owner of the object.
+        Call release_count later to deregister.
+        The first thread to call this becomes the owner thread.
+        */
+        static void acquire (biased_shared * s) noexcept {
+            if (s->owner == 0 && biased_shared_detail::queue_destroyed()) {
+                // This thread is exiting, so the object gets no owner thread,
+                // and only the shared count is used.
+                s->owner = no_owner;
+                s->shared_word.fetch_add (
+                    merged_flag, std::memory_order_relaxed);
+            }
+            if (s->owner == 0) {
+                // Claim ownership.
+                biased_shared_detail::owner_queue & queue
+                    = biased_shared_detail::current_queue();
+                s->owner = queue.id;
+                process_queue (queue);
+            }
+            if (s->use_biased()) {
+                // Only this thread writes to the biased count, so this need not
+                // be a read-modify-write operation.
+                s->biased_count.store (
+                    s->biased_count.load (std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+            } else
+                s->shared_word.fetch_add (
+                    count_unit, std::memory_order_relaxed);
+        }
+
+        /**
+        Release a reference to a biased_shared object.
+        \param storage
+            The storage policy of the pointer whose reference is released.
+            If the reference must be handed back to the owner thread, a copy of
+            this is kept so the object can be destructed later.
+        \return true iff this was the last reference, i.e. iff the object must
+        be deleted.
+        */
+        template <class Storage>
+            static bool release_count (biased_shared * s,
+                Storage const & storage) noexcept
+        {
+            if (s->use_biased()) {
+                long count = s->biased_count.load (std::memory_order_relaxed);
+                s->biased_count.store (count - 1, std::memory_order_relaxed);
+                if (count != 1)
+                    return false;
+                bool last = (s->merge() == 0);
+                if (!last)
+                    process_queue (biased_shared_detail::current_queue());
+                return last;
+            }
+            long word = s->shared_word.load (std::memory_order_relaxed);
+            if (!is_merged (word) && !is_queued (word)
+                    && !hand_back (s, storage))
+                return false;
+            return release_shared (s);
+        }
+
+        /**
+        \return The current number of owners of this object.
+        This is exact only if it is called from the owner thread or after the
+        counts have been merged.
+        */
+        static long get_count (biased_shared const * s) noexcept {
+            return s->biased_count.load (std::memory_order_relaxed)
+                + count_of (s->shared_word.load (std::memory_order_relaxed));
+        }
+
+        /**
+        Merge the counts of all objects that other threads have handed back to
+        the current thread, and release those references.
+        A thread that owns objects but that rarely acquires new ones should
+        call this regularly.
+        */
+        static void merge_queued() noexcept {
+            if (biased_shared_detail::current_id() != 0)
+                process_queue (biased_shared_detail::current_queue());
+        }
+    };
+
+    namespace biased_shared_detail {
+
+        /**
+        Queued reference that keeps a copy of the storage policy, so that it can
+        destruct the object if it releases the last reference.
+        */
+        template <class Storage> class queued_reference_with_storage
+        : public queued_reference, public Storage
+        {
+        public:
+            queued_reference_with_storage (biased_shared * object,
+                Storage const & storage) noexcept
+            : queued_reference (object), Storage (storage) {}
+
+            void release() noexcept override {
+                if (biased_shared::release_count (queued_reference::object,
+                        static_cast <Storage const &> (*this)))
+                {
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+                    shared_instrumentation::on_destruct <
+                        typename Storage::value_type>();
+#endif
+                    Storage::destruct();
+                }
+            }
+        };
+
+        owner_queue::owner_queue() noexcept
+        : has_queued (false), next_queue (nullptr), first (nullptr)
+        {
+            registry & r = registry::get();
+            id = ++ r.last_id;
+            current_id() = id;
+            std::lock_guard <spin_lock> lock (r.mutex);
+            next_queue = r.first_queue;
+            r.first_queue = this;
+        }
+
+        owner_queue::~owner_queue() noexcept {
+            // Destructors that run from here on must not use this queue, so
+            // this thread stops using its biased counts now.
+            queue_destroyed() = true;
+            current_id() = 0;
+            {
+                registry & r = registry::get();
+                std::lock_guard <spin_lock> lock (r.mutex);
+                owner_queue ** current = &r.first_queue;
+                while (*current != this)
+                    current = &(*current)->next_queue;
+                *current = next_queue;
+            }
+            // No references can be queued now.
+            process();
+        }
+
+        void owner_queue::process() noexcept {
+            queued_reference * current;
+            {
+                std::lock_guard <spin_lock> lock (registry::get().mutex);
+                current = first;
+                first = nullptr;
+                has_queued.store (false, std::memory_order_relaxed);
+            }
+            while (current) {
+                queued_reference * next = current->next;
+                biased_shared * object = current->object;
+                if (!biased_shared::is_merged (
+                        object->shared_word.load (std::memory_order_relaxed)))
+                    object->merge();
+                current->release();
+                delete current;
+                current = next;
+            }
+        }
+
+    } // namespace biased_shared_detail
+
+    template <class Storage>
+        inline bool biased_shared::hand_back (
+            biased_shared * s, Storage const & storage) noexcept
+    {
+        using namespace biased_shared_detail;
+        // Allocate before locking, and before setting the queued flag, so
+        // that failure leaves the object as it was.
+        queued_reference * reference = new (std::nothrow)
+            queued_reference_with_storage <Storage> (s, storage);
+        if (!reference) {
+            // Keep the reference, so that the object is never destructed.
+            return false;
+        }
+
+        registry & r = registry::get();
+        std::unique_lock <spin_lock> lock (r.mutex);
+
+        owner_queue * queue = r.find (s->owner);
+        if (!queue) {
+            // The owner has exited, so its biased count will not change any
+            // more, and this thread can merge.
+            // If the object was queued, the owner has merged or is merging
+            // while processing its queue.
+            // Otherwise, other threads only merge while holding the mutex.
+            long word = s->shared_word.load (std::memory_order_relaxed);
+            if (!is_merged (word) && !is_queued (word))
+                s->merge();
+            lock.unlock();
+            delete reference;
+            return true;
+        }
+
+        // Only one thread can set the queued flag.
+        long word = s->shared_word.load (std::memory_order_relaxed);
+        do {
+            if (is_merged (word) || is_queued (word)) {
+                lock.unlock();
+                delete reference;
+                return true;
+            }
+        } while (!s->shared_word.compare_exchange_weak (
+            word, word + queued_flag, std::memory_order_relaxed));
+
+        queue->push (reference);
+        return false;
+    }
+
+} // namespace utility
+
+#endif // UTILITY_BIASED_SHARED_HPP_INCLUDED
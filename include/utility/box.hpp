@@ -0,0 +1,68 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef UTILITY_BOX_HPP_INCLUDED
+#define UTILITY_BOX_HPP_INCLUDED
+
+#include "pointer_policy.hpp"
+
+namespace utility {
+
+    template <class Type> class box;
+
+    namespace detail {
+
+        template <class Type> struct box_policies {
+            typedef pointer_policy::strict_weak_ordered <
+                pointer_policy::pointer_access <
+                pointer_policy::inline_box <Type>>> type;
+        };
+
+    } // namespace detail
+
+    /**
+    Object with the interface of a pointer, that keeps its object inside.
+    Copying a box copies the object.
+    It can be empty.
+    The type does not need to derive from anything.
+
+    For small objects, this avoids heap allocation and indirection, and generic
+    code that uses operator*, operator->, get(), and construct() can switch
+    between a pointer type and box.
+    Unlike for small_ptr, construct() does not take an allocator.
+    \sa pointer_policy::inline_box
+    */
+    template <class Type> class box
+    : public pointer_policy::pointer <
+        typename detail::box_policies <Type>::type, box <Type>>
+    {
+        typedef typename detail::box_policies <Type>::type policies_type;
+        typedef pointer_policy::pointer <policies_type, box> base_type;
+    public:
+        template <class ... Arguments>
+            explicit box (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        box (box const &) = default;
+        box (box &&) = default;
+
+        box & operator = (box const &) = default;
+        box & operator = (box &&) = default;
+    };
+
+} // namespace utility
+
+#endif // UTILITY_BOX_HPP_INCLUDED
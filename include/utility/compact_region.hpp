@@ -0,0 +1,214 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Contiguous region of memory, in which objects can be referred to by a 32-bit
+index instead of a pointer.
+
+Pointers take 8 bytes on 64-bit platforms, and in large graphs of small
+objects, they can take up most of the memory.
+If all objects are allocated in one contiguous region, an object can be
+identified by its offset from the start of the region, divided by the
+alignment of all blocks.
+With 32 bits and 16-byte alignment, a region can be up to 64 GiB.
+compact_ptr uses this.
+*/
+
+#ifndef UTILITY_COMPACT_REGION_HPP_INCLUDED
+#define UTILITY_COMPACT_REGION_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <cassert>
+
+namespace utility {
+
+    /**
+    Region of memory that is reserved in one go, and from which blocks are
+    allocated.
+    Deallocated blocks are kept in a free list for each size and reused.
+    All state is static, so that a compact_ptr only needs to store an index;
+    \a Tag distinguishes regions.
+    This is not thread-safe.
+
+    initialize() must be called before the first allocation, and release()
+    may be called after the last object has been deallocated.
+    */
+    template <class Tag> class compact_region {
+    public:
+        /// The alignment of all blocks, and the unit of indices.
+        static constexpr std::size_t granularity = alignof (std::max_align_t);
+
+        /// The largest block size.
+        static constexpr std::size_t max_block_size = 256;
+
+        /// The largest capacity, so that all indices fit in 32 bits.
+        static constexpr std::size_t max_capacity
+            = std::size_t (std::numeric_limits <std::uint32_t>::max())
+                * granularity;
+
+    private:
+        struct free_block { free_block * next; };
+
+        static constexpr std::size_t size_class_num
+            = max_block_size / granularity;
+
+        struct state {
+            char * base;
+            std::size_t position;
+            std::size_t capacity;
+            free_block * free [size_class_num];
+        };
+
+        static state & get() noexcept {
+            static state s = { nullptr, 0, 0, {} };
+            return s;
+        }
+
+        static std::size_t size_class (std::size_t size) noexcept {
+            assert (size != 0 && size <= max_block_size);
+            return (size - 1) / granularity;
+        }
+
+    public:
+        /**
+        Reserve \a capacity bytes.
+        \pre The region is not initialised.
+        \throw std::bad_alloc If the memory cannot be allocated.
+        */
+        static void initialize (std::size_t capacity) {
+            state & s = get();
+            assert (!s.base);
+            assert (capacity <= max_capacity);
+            s.base = static_cast <char *> (::operator new (capacity));
+            // Index 0 means "empty", so do not hand out the first block.
+            s.position = granularity;
+            s.capacity = capacity;
+            for (free_block * & f : s.free)
+                f = nullptr;
+        }
+
+        /**
+        Release the memory.
+        All objects in the region must have been destructed.
+        */
+        static void release() noexcept {
+            state & s = get();
+            ::operator delete (s.base);
+            s.base = nullptr;
+            s.position = 0;
+            s.capacity = 0;
+        }
+
+        /// \return The start of the region.
+        static char * base() noexcept { return get().base; }
+
+        /// \return The number of bytes that have ever been handed out.
+        static std::size_t used() noexcept { return get().position; }
+
+        /**
+        \return A block of \a size bytes, aligned to granularity.
+        \throw std::bad_alloc If the region is full.
+        */
+        static void * allocate (std::size_t size) {
+            state & s = get();
+            free_block * & free = s.free [size_class (size)];
+            if (free) {
+                free_block * block = free;
+                free = block->next;
+                return block;
+            }
+            std::size_t block_size
+                = (size_class (size) + 1) * granularity;
+            if (s.capacity - s.position < block_size)
+                throw std::bad_alloc();
+            void * block = s.base + s.position;
+            s.position += block_size;
+            return block;
+        }
+
+        /**
+        Return a block of \a size bytes to the region.
+        */
+        static void deallocate (void * memory, std::size_t size) noexcept {
+            free_block * block = static_cast <free_block *> (memory);
+            free_block * & free = get().free [size_class (size)];
+            block->next = free;
+            free = block;
+        }
+
+        /// \return The index of \a object, which must be in the region.
+        static std::uint32_t index_of (void const * object) noexcept {
+            return std::uint32_t (
+                (static_cast <char const *> (object) - base()) / granularity);
+        }
+
+        /// \return The address that corresponds to \a index.
+        static void * address_of (std::uint32_t index) noexcept
+        { return base() + std::size_t (index) * granularity; }
+    };
+
+    template <class Tag>
+        constexpr std::size_t compact_region <Tag>::granularity;
+    template <class Tag>
+        constexpr std::size_t compact_region <Tag>::max_block_size;
+    template <class Tag>
+        constexpr std::size_t compact_region <Tag>::max_capacity;
+
+    /**
+    Stateless allocator that allocates single objects from a compact_region.
+    This can be used, for example, to put objects for small_ptr in a region.
+    */
+    template <class Type, class Tag> class compact_region_allocator {
+    public:
+        typedef Type value_type;
+
+        template <class Other> struct rebind
+        { typedef compact_region_allocator <Other, Tag> other; };
+
+        compact_region_allocator() noexcept {}
+
+        template <class Other> compact_region_allocator (
+            compact_region_allocator <Other, Tag> const &) noexcept {}
+
+        Type * allocate (std::size_t n) {
+            static_assert (alignof (Type) <= compact_region <Tag>::granularity,
+                "Over-aligned types are not supported.");
+            if (n * sizeof (Type) > compact_region <Tag>::max_block_size)
+                throw std::bad_alloc();
+            return static_cast <Type *> (
+                compact_region <Tag>::allocate (n * sizeof (Type)));
+        }
+
+        void deallocate (Type * object, std::size_t n) noexcept
+        { compact_region <Tag>::deallocate (object, n * sizeof (Type)); }
+    };
+
+    template <class Type1, class Type2, class Tag>
+        inline bool operator == (compact_region_allocator <Type1, Tag> const &,
+            compact_region_allocator <Type2, Tag> const &) noexcept
+    { return true; }
+
+    template <class Type1, class Type2, class Tag>
+        inline bool operator != (compact_region_allocator <Type1, Tag> const &,
+            compact_region_allocator <Type2, Tag> const &) noexcept
+    { return false; }
+
+} // namespace utility
+
+#endif // UTILITY_COMPACT_REGION_HPP_INCLUDED
@@ -0,0 +1,200 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef UTILITY_COMPACT_SHARED_HPP_INCLUDED
+#define UTILITY_COMPACT_SHARED_HPP_INCLUDED
+
+#include <atomic>
+#include <limits>
+#include <type_traits>
+
+#include "config.hpp"
+
+namespace utility {
+
+    /**
+    Empty base class of all instantiations of compact_shared, so that they can
+    be detected.
+    */
+    class compact_shared_base {};
+
+    /**
+    Base class for reference-counted objects with a small count.
+    This can be used with small_ptr instead of utility::shared, which always
+    uses a long.
+    For small objects, this can save a large part of the memory.
+
+    The count is kept in an atomic \a Integer, which should be an unsigned
+    type, like std::uint32_t or std::uint16_t.
+    The lowest \a TagBits bits of it hold a tag instead of the count.
+    The tag can hold, for example, a type identifier or a generation number for
+    debugging or for pools.
+    It is not touched when the count changes.
+
+    Since the count is small, it could overflow.
+    Instead, it "saturates", like the Linux kernel's refcount_t: when it reaches
+    half its range, it is set to three quarters of its range, and from then on
+    it is treated as fixed, so the object is never destructed.
+    This leaks the object, but never destructs it while it is still in use.
+    Before changing the count, acquire and release_count check that it has
+    not saturated.
+    Threads that pass this check at the same time as the count saturates can
+    still change it, but they would have to number a quarter of the range to
+    move it out of the saturated range.
+
+    As for utility::shared, acquiring a reference is relaxed, and releasing it
+    has release semantics, with an acquire fence before destruction.
+
+    \tparam Integer The unsigned integer type that holds the count and the tag.
+    \tparam TagBits The number of bits for the tag.
+    */
+    template <class Integer, unsigned TagBits = 0> class compact_shared
+    : public compact_shared_base
+    {
+        static_assert (std::is_unsigned <Integer>::value,
+            "The count must be an unsigned integer type.");
+        static_assert (TagBits < std::numeric_limits <Integer>::digits - 1,
+            "At least two bits must remain for the count.");
+
+    public:
+        typedef Integer integer_type;
+
+        /// The number of bits of the tag.
+        static constexpr unsigned tag_bits = TagBits;
+
+        /// The largest count that fits.
+        static constexpr Integer max_count
+            = std::numeric_limits <Integer>::max() >> TagBits;
+
+        /// The value that the count is set to when it saturates.
+        static constexpr Integer saturated_count = max_count - max_count / 4;
+
+    private:
+        std::atomic <Integer> word;
+
+        static constexpr Integer count_unit = Integer (1) << TagBits;
+        static constexpr Integer tag_mask = count_unit - 1;
+        /// Count from which the count is set to max_count.
+        static constexpr Integer saturation_threshold = max_count / 2 + 1;
+
+        static constexpr Integer count_of (Integer word) noexcept
+        { return word >> TagBits; }
+
+        /**
+        Set the count to saturated_count, keeping the tag.
+        Other threads may be changing the count too, but they will all
+        set it to saturated_count.
+        */
+        void saturate (Integer old_word) noexcept {
+            word.store (Integer (
+                    (saturated_count << TagBits) | (old_word & tag_mask)),
+                std::memory_order_relaxed);
+        }
+
+    protected:
+        explicit compact_shared (Integer tag = 0) noexcept
+        : word (Integer (tag & tag_mask)) {}
+
+        // The copy and move constructors mustn't copy the count, but they do
+        // copy the tag.
+        compact_shared (compact_shared const & that) noexcept
+        : compact_shared_base(), word (Integer (get_tag (&that))) {}
+        compact_shared (compact_shared && that) noexcept
+        : compact_shared_base(), word (Integer (get_tag (&that))) {}
+
+        // Assignment mustn't copy the count or the tag.
+        compact_shared & operator = (compact_shared const &) noexcept
+        { return *this; }
+        compact_shared & operator = (compact_shared &&) noexcept
+        { return *this; }
+
+    public:
+        /**
+        Register as an owner of the object.
+        Call release_count later to deregister.
+        */
+        static void acquire (compact_shared * s) noexcept {
+            if (is_saturated (s))
+                return;
+            Integer old_word = s->word.fetch_add (
+                count_unit, std::memory_order_relaxed);
+            if (count_of (old_word) + 1 >= saturation_threshold)
+                s->saturate (old_word);
+        }
+
+        /**
+        Release a reference to a compact_shared object.
+        \return true iff this was the last reference, i.e. iff the object must
+        be deleted.
+        This is never true once the count has saturated.
+        */
+        static bool release_count (compact_shared * s) noexcept {
+            if (is_saturated (s))
+                return false;
+            Integer old_word = s->word.fetch_sub (
+                count_unit, UTILITY_CONFIG_RELEASE_COUNT_ORDER);
+            Integer old_count = count_of (old_word);
+            if (old_count == 1) {
+                std::atomic_thread_fence (std::memory_order_acquire);
+                return true;
+            }
+            if (old_count >= saturation_threshold)
+                s->saturate (old_word);
+            return false;
+        }
+
+        /**
+        \return The current number of owners of this object.
+        If the count has saturated, this returns about saturated_count.
+        */
+        static long get_count (compact_shared const * s) noexcept
+        { return count_of (s->word.load (std::memory_order_relaxed)); }
+
+        /**
+        \return true iff the count has saturated, so that the object will never
+        be destructed.
+        */
+        static bool is_saturated (compact_shared const * s) noexcept
+        { return get_count (s) >= long (saturation_threshold); }
+
+        /**
+        \return The tag.
+        */
+        static Integer get_tag (compact_shared const * s) noexcept
+        { return s->word.load (std::memory_order_relaxed) & tag_mask; }
+
+        /**
+        Set the tag to the lowest \a TagBits bits of \a tag.
+        This does not change the count, even if other threads change it at the
+        same time.
+        */
+        static void set_tag (compact_shared * s, Integer tag) noexcept {
+            Integer old_word = s->word.load (std::memory_order_relaxed);
+            while (!s->word.compare_exchange_weak (old_word,
+                Integer ((old_word & ~tag_mask) | (tag & tag_mask)),
+                std::memory_order_relaxed))
+            {}
+        }
+    };
+
+    template <class Integer, unsigned TagBits>
+        constexpr Integer compact_shared <Integer, TagBits>::max_count;
+    template <class Integer, unsigned TagBits>
+        constexpr Integer compact_shared <Integer, TagBits>::saturated_count;
+
+} // namespace utility
+
+#endif // UTILITY_COMPACT_SHARED_HPP_INCLUDED
@@ -38,4 +38,27 @@ limitations under the License.
 
 #endif
 
+/*
+Reference counts are decreased with release semantics, and the thread that
+releases the last reference issues an acquire fence before it destructs the
+object.
+Thread Sanitizer does not model fences, so it reports a data race on the
+destruction.
+When it is switched on, UTILITY_CONFIG_THREAD_SANITIZER is defined, and the
+decrements use acquire-release semantics, which it does understand.
+*/
+#if defined __SANITIZE_THREAD__
+#   define UTILITY_CONFIG_THREAD_SANITIZER
+#elif defined __has_feature
+#   if __has_feature (thread_sanitizer)
+#       define UTILITY_CONFIG_THREAD_SANITIZER
+#   endif
+#endif
+
+#ifdef UTILITY_CONFIG_THREAD_SANITIZER
+#   define UTILITY_CONFIG_RELEASE_COUNT_ORDER std::memory_order_acq_rel
+#else
+#   define UTILITY_CONFIG_RELEASE_COUNT_ORDER std::memory_order_release
+#endif
+
 #endif // UTILITY_CONFIG_HPP_INCLUDED
@@ -0,0 +1,293 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Deferred release of references to objects derived from utility::shared.
+
+Instead of decreasing the count of an object straight away, a release is
+recorded in a buffer that is local to the thread.
+Repeated releases of the same object are coalesced.
+If the thread acquires a reference to an object while a release is pending for
+it, the two cancel out, and the count is not touched at all.
+The pending releases are applied, with one atomic operation per object, when
+flush_deferred_releases() is called, when the buffer needs space, or when the
+thread exits.
+Only then are objects destructed.
+*/
+
+#ifndef UTILITY_DEFERRED_RELEASE_HPP_INCLUDED
+#define UTILITY_DEFERRED_RELEASE_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/optional.hpp>
+
+#include "shared.hpp"
+
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+#include "shared_instrumentation.hpp"
+#endif
+
+namespace utility { namespace pointer_policy {
+
+    namespace deferred_release_detail {
+
+        /**
+        Base class for the buffers of pending releases for one storage type.
+        The buffers for one thread form a linked list.
+        */
+        class buffer_base {
+        public:
+            buffer_base() noexcept : next (nullptr) {}
+            virtual ~buffer_base() noexcept {}
+
+            /// Apply all pending releases.
+            virtual void flush() noexcept = 0;
+
+            buffer_base * next;
+        };
+
+        /// \return The first buffer in the list for this thread.
+        inline buffer_base * & first_buffer() noexcept {
+            static thread_local buffer_base * first = nullptr;
+            return first;
+        }
+
+        /**
+        \return A reference to the number of real releases that this thread is
+        currently in the middle of.
+        Releases that happen during those, for example from the destructors of
+        objects, are not deferred.
+        This prevents recursion through the buffer.
+        */
+        inline unsigned & release_depth() noexcept {
+            static thread_local unsigned depth = 0;
+            return depth;
+        }
+
+        class release_scope {
+        public:
+            release_scope() noexcept { ++ release_depth(); }
+            ~release_scope() noexcept { -- release_depth(); }
+        };
+
+        /**
+        Direct-mapped buffer of pending releases for one storage policy type.
+        Each slot holds an object, the number of releases pending for it, which
+        is always positive, and a copy of the storage policy to destruct it
+        with.
+        Because of the pending releases, the object stays alive while it is in
+        the slot.
+        */
+        template <class Storage> class buffer : public buffer_base {
+        public:
+            typedef typename Storage::value_type value_type;
+
+        private:
+            static constexpr std::size_t slot_count = 64;
+
+            /// Copy of the storage policy that can destruct the object.
+            class releaser : public Storage {
+            public:
+                explicit releaser (Storage const & storage) noexcept
+                : Storage (storage) {}
+
+                void destruct() noexcept { Storage::destruct(); }
+            };
+
+            struct slot {
+                value_type * object;
+                long pending;
+                boost::optional <releaser> storage;
+
+                slot() noexcept : object (nullptr), pending (0) {}
+            };
+
+            slot slots [slot_count];
+
+            static slot & slot_for (buffer & b, value_type const * object)
+                noexcept
+            {
+                std::uintptr_t address
+                    = reinterpret_cast <std::uintptr_t> (object);
+                return b.slots [(address / alignof (value_type)) % slot_count];
+            }
+
+            /**
+            Empty the slot and apply its pending releases.
+            The slot is emptied first, so that destructors can use the buffer.
+            */
+            static void release_slot (slot & s) noexcept {
+                if (!s.object)
+                    return;
+                value_type * object = s.object;
+                long pending = s.pending;
+                releaser storage = *s.storage;
+                s.object = nullptr;
+                s.pending = 0;
+                s.storage = boost::none;
+
+                release_scope scope;
+                if (shared::release_count (object, pending)) {
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+                    shared_instrumentation::on_destruct <value_type>();
+#endif
+                    storage.destruct();
+                }
+            }
+
+        public:
+            buffer() noexcept {
+                next = first_buffer();
+                first_buffer() = this;
+            }
+
+            ~buffer() noexcept {
+                // Releases from destructors of thread_local objects that run
+                // after this must not use this buffer.
+                destroyed() = true;
+                flush();
+                // Remove this from the list.
+                buffer_base ** current = &first_buffer();
+                while (*current != this)
+                    current = &(*current)->next;
+                *current = next;
+            }
+
+            void flush() noexcept override {
+                for (slot & s : slots)
+                    release_slot (s);
+            }
+
+            /// \return The buffer for the current thread.
+            static buffer & current() {
+                static thread_local buffer instance;
+                return instance;
+            }
+
+            /**
+            \return A reference to whether the buffer for the current thread
+            has been destructed.
+            This is trivially destructible, so it can be read after that.
+            Then, references are acquired and released straight away.
+            */
+            static bool & destroyed() noexcept {
+                static thread_local bool value = false;
+                return value;
+            }
+
+            /**
+            Acquire a reference to \a object.
+            If a release is pending for it, cancel that instead.
+            */
+            static void acquire (value_type * object) noexcept {
+                if (destroyed()) {
+                    shared::acquire (object);
+                    return;
+                }
+                slot & s = slot_for (current(), object);
+                if (s.object == object) {
+                    // The slot must not keep a pointer to an object that it
+                    // does not hold a reference to.
+                    if (-- s.pending == 0) {
+                        s.object = nullptr;
+                        s.storage = boost::none;
+                    }
+                } else
+                    shared::acquire (object);
+            }
+
+            /**
+            Record a pending release of \a object.
+            \return true iff the object must be destructed now.
+            This can only happen if the release is not deferred because this
+            thread is in the middle of a real release.
+            */
+            static bool release_count (value_type * object,
+                Storage const & storage) noexcept
+            {
+                if (release_depth() != 0 || destroyed())
+                    return shared::release_count (object);
+
+                slot & s = slot_for (current(), object);
+                if (s.object != object) {
+                    // Make space.
+                    release_slot (s);
+                    s.object = object;
+                    s.storage = releaser (storage);
+                }
+                ++ s.pending;
+                return false;
+            }
+
+            /**
+            \return The number of releases of \a object that are pending in
+            this thread.
+            */
+            static long pending (value_type const * object) noexcept {
+                if (destroyed())
+                    return 0;
+                slot & s = slot_for (current(), object);
+                return s.object == object ? s.pending : 0;
+            }
+        };
+
+    } // namespace deferred_release_detail
+
+    /**
+    Reference count operations for objects derived from utility::shared, that
+    defer releases.
+    \tparam Storage The storage policy of the pointers.
+    */
+    template <class Storage> struct deferred_shared_count {
+    private:
+        typedef deferred_release_detail::buffer <Storage> buffer;
+        typedef typename Storage::value_type value_type;
+
+    public:
+        static void acquire (value_type * object) noexcept
+        { buffer::acquire (object); }
+
+        static bool release_count (value_type * object,
+            Storage const & storage) noexcept
+        { return buffer::release_count (object, storage); }
+
+        /**
+        \return The number of owners of the object, minus the releases that are
+        pending in the current thread.
+        Releases that are pending in other threads are still counted.
+        */
+        static long get_count (value_type const * object) noexcept
+        { return shared::get_count (object) - buffer::pending (object); }
+    };
+
+    /**
+    Apply all releases that are pending in the current thread.
+    This may destruct objects.
+    Releases from their destructors are not deferred, so this leaves the
+    buffers empty.
+    */
+    inline void flush_deferred_releases() noexcept {
+        for (deferred_release_detail::buffer_base * current
+                = deferred_release_detail::first_buffer();
+                current; current = current->next)
+            current->flush();
+    }
+
+}} // namespace utility::pointer_policy
+
+#endif // UTILITY_DEFERRED_RELEASE_HPP_INCLUDED
@@ -0,0 +1,311 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Epoch-based reclamation.
+
+Readers of a shared data structure "pin" the current epoch with an
+epoch::guard, and can then follow pointers without touching any counts.
+A writer that unlinks an object from the data structure "retires" it.
+The object is destructed only when all threads have passed the epoch in which
+it was retired, so that no reader can still be looking at it.
+
+There is a global epoch counter.
+A thread that pins the epoch records its value.
+The global epoch can be advanced only when all pinned threads have recorded
+the current value.
+An object retired in epoch e can be destructed when the global epoch is
+e + 2: all threads that were pinned when it was retired have unpinned by then.
+
+Each thread keeps its own list of retired objects.
+It destructs those that it can when the list gets long, when collect() is
+called, and when the thread exits.
+A reader that stays pinned for a long time holds up reclamation for all
+threads.
+*/
+
+#ifndef UTILITY_EPOCH_HPP_INCLUDED
+#define UTILITY_EPOCH_HPP_INCLUDED
+
+#include <cstddef>
+#include <atomic>
+#include <thread>
+
+namespace utility { namespace epoch {
+
+    namespace detail {
+
+        static constexpr std::size_t cache_line_size = 64;
+
+        /// The global epoch.
+        inline std::atomic <unsigned long> & global_epoch() noexcept {
+            static std::atomic <unsigned long> epoch (0);
+            return epoch;
+        }
+
+        /**
+        Record for one thread.
+        \c state is 0 if the thread is not pinned, and <c>2 * epoch + 1</c> if
+        it is.
+        Each record is padded to a cache line.
+        */
+        struct record {
+            std::atomic <unsigned long> state;
+            std::atomic <bool> in_use;
+            record * next;
+            char padding [cache_line_size - sizeof (std::atomic <unsigned long>)
+                - sizeof (std::atomic <bool>) - sizeof (record *)];
+
+            record() noexcept : state (0), in_use (true), next (nullptr) {}
+        };
+
+        /**
+        Lock-free list of the records of all threads.
+        Records are only ever added, and are reused after a thread exits.
+        */
+        class record_list {
+            std::atomic <record *> first;
+
+        public:
+            constexpr record_list() noexcept : first (nullptr) {}
+
+            static record_list & get() noexcept {
+                static record_list instance;
+                return instance;
+            }
+
+            record * begin() const noexcept
+            { return first.load (std::memory_order_acquire); }
+
+            record * claim() {
+                for (record * r = begin(); r; r = r->next) {
+                    bool in_use = r->in_use.load (std::memory_order_relaxed);
+                    if (!in_use && r->in_use.compare_exchange_strong (
+                            in_use, true, std::memory_order_acquire))
+                        return r;
+                }
+                record * r = new record;
+                record * old_first = first.load (std::memory_order_relaxed);
+                do
+                    r->next = old_first;
+                while (!first.compare_exchange_weak (old_first, r,
+                    std::memory_order_release, std::memory_order_relaxed));
+                return r;
+            }
+        };
+
+        /**
+        Advance the global epoch if all pinned threads have seen its current
+        value.
+        \return The global epoch after the attempt.
+        */
+        inline unsigned long try_advance() noexcept {
+            unsigned long epoch
+                = global_epoch().load (std::memory_order_seq_cst);
+            // Pairs with the fence in thread_state::pin().
+            // The objects that this thread has unlinked must be unreachable
+            // for any thread that this scan does not see pinned.
+            std::atomic_thread_fence (std::memory_order_seq_cst);
+            for (record * r = record_list::get().begin(); r; r = r->next) {
+                unsigned long state = r->state.load (std::memory_order_seq_cst);
+                if (state != 0 && state != 2 * epoch + 1)
+                    return epoch;
+            }
+            if (global_epoch().compare_exchange_strong (
+                    epoch, epoch + 1, std::memory_order_seq_cst))
+                return epoch + 1;
+            // Another thread has advanced the epoch.
+            return epoch;
+        }
+
+        /**
+        Object that has been retired, and is waiting for its epoch to pass.
+        */
+        class retired_base {
+        public:
+            retired_base() noexcept : epoch (0), next (nullptr) {}
+            virtual ~retired_base() noexcept {}
+
+            /// Destruct the object.
+            virtual void destruct() noexcept = 0;
+
+            unsigned long epoch;
+            retired_base * next;
+        };
+
+        /**
+        Retired object, with a copy of the storage policy that destructs it.
+        */
+        template <class Storage> class retired_object
+        : public retired_base, public Storage
+        {
+        public:
+            explicit retired_object (Storage const & storage) noexcept
+            : Storage (storage) {}
+
+            void destruct() noexcept override { Storage::destruct(); }
+        };
+
+        /**
+        State of the current thread: its record, how deeply it is pinned, and
+        the list of objects it has retired, oldest first.
+        */
+        class thread_state {
+            record * r;
+            unsigned depth;
+            retired_base * first;
+            retired_base * last;
+            std::size_t count;
+
+            /// Retire objects in batches of this size.
+            static constexpr std::size_t collect_threshold = 64;
+
+        public:
+            thread_state()
+            : r (record_list::get().claim()), depth (0),
+                first (nullptr), last (nullptr), count (0) {}
+
+            /**
+            At thread exit, wait for other threads to unpin the epochs in
+            which objects were retired, and destruct them.
+            */
+            ~thread_state() noexcept {
+                depth = 0;
+                r->state.store (0, std::memory_order_release);
+                while (true) {
+                    collect();
+                    if (!first)
+                        break;
+                    std::this_thread::yield();
+                }
+                r->in_use.store (false, std::memory_order_release);
+            }
+
+            static thread_state & current() {
+                static thread_local thread_state state;
+                return state;
+            }
+
+            void pin() noexcept {
+                if (depth ++ == 0) {
+                    unsigned long epoch
+                        = global_epoch().load (std::memory_order_relaxed);
+                    while (true) {
+                        r->state.store (
+                            2 * epoch + 1, std::memory_order_relaxed);
+                        // The store must be visible to other threads before
+                        // this thread reads the data structure.
+                        // A seq_cst store does not order later acquire loads
+                        // after it; a fence does.
+                        // It pairs with the fence in try_advance().
+                        std::atomic_thread_fence (std::memory_order_seq_cst);
+                        // If the epoch has moved, try_advance() may not have
+                        // seen this thread, so publish the new epoch.
+                        unsigned long current
+                            = global_epoch().load (std::memory_order_relaxed);
+                        if (current == epoch)
+                            break;
+                        epoch = current;
+                    }
+                }
+            }
+
+            void unpin() noexcept {
+                if (-- depth == 0)
+                    // This releases the reads from the data structure.
+                    r->state.store (0, std::memory_order_release);
+            }
+
+            void retire (retired_base * object) noexcept {
+                object->epoch
+                    = global_epoch().load (std::memory_order_seq_cst);
+                if (last)
+                    last->next = object;
+                else
+                    first = object;
+                last = object;
+                if (++ count >= collect_threshold)
+                    collect();
+            }
+
+            /**
+            Try to advance the epoch, and destruct all objects that no thread
+            can be reading.
+            Destructors can retire further objects.
+            */
+            void collect() noexcept {
+                unsigned long epoch = try_advance();
+                while (first && first->epoch + 2 <= epoch) {
+                    retired_base * object = first;
+                    first = object->next;
+                    if (!first)
+                        last = nullptr;
+                    -- count;
+                    object->destruct();
+                    delete object;
+                }
+            }
+
+            std::size_t retired_count() const noexcept { return count; }
+        };
+
+    } // namespace detail
+
+    /**
+    Pin the current epoch for as long as this object exists.
+    While it does, objects that the current thread can reach through a shared
+    data structure are not destructed, even if other threads retire them.
+    Guards can be nested.
+    */
+    class guard {
+        detail::thread_state & state;
+    public:
+        guard() : state (detail::thread_state::current()) { state.pin(); }
+        ~guard() noexcept { state.unpin(); }
+
+        guard (guard const &) = delete;
+        guard & operator = (guard const &) = delete;
+    };
+
+    /**
+    Retire the object that \a storage refers to.
+    It will be destructed with <c>storage.destruct()</c> once no thread can be
+    reading it.
+    The object must already be unreachable for readers that pin the epoch
+    later.
+    */
+    template <class Storage> inline void retire (Storage const & storage) {
+        // If this allocation fails, the program is terminated.
+        detail::thread_state::current().retire (
+            new detail::retired_object <Storage> (storage));
+    }
+
+    /**
+    Try to advance the epoch, and destruct the objects retired by the current
+    thread that no thread can be reading any more.
+    */
+    inline void collect() { detail::thread_state::current().collect(); }
+
+    /**
+    \return The number of objects that the current thread has retired and that
+    have not been destructed yet.
+    */
+    inline std::size_t retired_count()
+    { return detail::thread_state::current().retired_count(); }
+
+}} // namespace utility::epoch
+
+#endif // UTILITY_EPOCH_HPP_INCLUDED
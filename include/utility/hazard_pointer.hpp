@@ -0,0 +1,265 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Hazard pointers, which let a thread read a pointer from shared memory and use
+the object it points to, even if another thread removes the pointer at the same
+time.
+
+A reader publishes the pointer that it is about to use in its hazard pointer,
+and then checks that the shared memory still contains it.
+A writer that removes a pointer from shared memory does not release it
+immediately, but "retires" it.
+Retired pointers are only released when no hazard pointer refers to them.
+
+Each thread has one hazard pointer, which is claimed the first time it is
+needed and handed back when the thread exits.
+The records for the hazard pointers are never deallocated, so that they can be
+scanned without locking.
+*/
+
+#ifndef UTILITY_HAZARD_POINTER_HPP_INCLUDED
+#define UTILITY_HAZARD_POINTER_HPP_INCLUDED
+
+#include <cstddef>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <thread>
+
+namespace utility { namespace hazard_pointer {
+
+    namespace detail {
+
+        static constexpr std::size_t cache_line_size = 64;
+
+        /**
+        Record for one hazard pointer.
+        Each record is padded to a cache line, so that threads that publish
+        hazard pointers do not interfere with each other much.
+        */
+        struct record {
+            std::atomic <void const *> hazard;
+            std::atomic <bool> in_use;
+            record * next;
+            char padding [cache_line_size - sizeof (std::atomic <void const *>)
+                - sizeof (std::atomic <bool>) - sizeof (record *)];
+
+            record() noexcept : hazard (nullptr), in_use (true), next (nullptr)
+            {}
+        };
+
+        /**
+        Lock-free list of all records.
+        Records are only ever added.
+        */
+        class record_list {
+            std::atomic <record *> first;
+            std::atomic <std::size_t> size_;
+
+        public:
+            constexpr record_list() noexcept : first (nullptr), size_ (0) {}
+
+            static record_list & get() noexcept {
+                static record_list instance;
+                return instance;
+            }
+
+            record * begin() const noexcept
+            { return first.load (std::memory_order_acquire); }
+
+            std::size_t size() const noexcept
+            { return size_.load (std::memory_order_relaxed); }
+
+            /**
+            Claim a record that is not in use, or add a new one.
+            */
+            record * claim() {
+                for (record * r = begin(); r; r = r->next) {
+                    bool in_use = r->in_use.load (std::memory_order_relaxed);
+                    if (!in_use && r->in_use.compare_exchange_strong (
+                            in_use, true, std::memory_order_acquire))
+                        return r;
+                }
+                record * r = new record;
+                record * old_first = first.load (std::memory_order_relaxed);
+                do
+                    r->next = old_first;
+                while (!first.compare_exchange_weak (old_first, r,
+                    std::memory_order_release, std::memory_order_relaxed));
+                size_.fetch_add (1, std::memory_order_relaxed);
+                return r;
+            }
+        };
+
+        /**
+        Owner of the record for the current thread.
+        The record is handed back when the thread exits.
+        */
+        class record_owner {
+        public:
+            record * r;
+
+            record_owner() : r (record_list::get().claim()) {}
+
+            ~record_owner() noexcept {
+                r->hazard.store (nullptr, std::memory_order_relaxed);
+                r->in_use.store (false, std::memory_order_release);
+            }
+        };
+
+        /**
+        \return The hazard pointer record for the current thread.
+        */
+        inline record & current_record() {
+            static thread_local record_owner owner;
+            return *owner.r;
+        }
+
+        /**
+        \return A sorted list of all pointers that are currently hazardous.
+        */
+        inline std::vector <void const *> collect_hazards() {
+            std::vector <void const *> hazards;
+            hazards.reserve (record_list::get().size());
+            for (record * r = record_list::get().begin(); r; r = r->next) {
+                void const * hazard
+                    = r->hazard.load (std::memory_order_seq_cst);
+                if (hazard)
+                    hazards.push_back (hazard);
+            }
+            std::sort (hazards.begin(), hazards.end());
+            return hazards;
+        }
+
+    } // namespace detail
+
+    /**
+    Protect \a pointer, which was read from \a source, with the hazard pointer
+    of the current thread, if \a source still contains it.
+    \param pointer
+        Is set to the current value of \a source if that is different.
+    \return true iff \a pointer is protected.
+    The caller must then call clear() when it does not need the protection
+    any more.
+    If this returns false, the object that \a pointer pointed to may have been
+    destructed.
+    */
+    template <class Type> inline
+        bool try_protect (std::atomic <Type *> const & source, Type * & pointer)
+    {
+        // Publish, and then check that "source" did not change in the
+        // meantime.
+        // seq_cst is required: the store must be visible to writers before
+        // this thread loads "source" again.
+        detail::current_record().hazard.store (
+            pointer, std::memory_order_seq_cst);
+        Type * again = source.load (std::memory_order_seq_cst);
+        if (again == pointer)
+            return true;
+        pointer = again;
+        return false;
+    }
+
+    /**
+    Read a pointer from \a source and protect the object it points to with the
+    hazard pointer of the current thread.
+    The caller must call clear() when it does not need the protection any
+    more, for example after it has acquired a reference to the object.
+    Only one pointer can be protected at a time.
+    */
+    template <class Type> inline
+        Type * protect (std::atomic <Type *> const & source)
+    {
+        Type * pointer = source.load (std::memory_order_relaxed);
+        while (!try_protect (source, pointer)) {}
+        return pointer;
+    }
+
+    /**
+    Stop protecting the pointer that protect() returned.
+    */
+    inline void clear() {
+        detail::current_record().hazard.store (
+            nullptr, std::memory_order_release);
+    }
+
+    /**
+    List of retired references of one type, local to the current thread.
+    \tparam Reference
+        Type that owns a reference, such as a smart pointer, which releases the
+        reference when it is destructed.
+        It must have a member function get() that returns the raw pointer.
+    */
+    template <class Reference> class retired_list {
+        std::vector <Reference> references;
+
+        retired_list() {}
+
+        /**
+        Release all references that are not protected by a hazard pointer.
+        */
+        void scan() {
+            std::vector <void const *> hazards = detail::collect_hazards();
+            // Move the references that are still hazardous to the start.
+            auto end = std::partition (references.begin(), references.end(),
+                [&hazards] (Reference const & reference) {
+                    return std::binary_search (hazards.begin(), hazards.end(),
+                        static_cast <void const *> (reference.get()));
+                });
+            references.erase (end, references.end());
+        }
+
+    public:
+        /**
+        At thread exit, wait for other threads to stop using the objects.
+        Readers hold hazard pointers only briefly.
+        */
+        ~retired_list() {
+            while (true) {
+                scan();
+                if (references.empty())
+                    break;
+                std::this_thread::yield();
+            }
+        }
+
+        static retired_list & current() {
+            static thread_local retired_list instance;
+            return instance;
+        }
+
+        /**
+        Retire \a reference, and release retired references that are not
+        hazardous, if there are many.
+        */
+        void retire (Reference && reference) {
+            references.push_back (std::move (reference));
+            if (references.size() >= 2 * detail::record_list::get().size() + 8)
+                scan();
+        }
+
+        /**
+        Release all retired references that are not hazardous.
+        */
+        void reclaim() { scan(); }
+
+        std::size_t size() const { return references.size(); }
+    };
+
+}} // namespace utility::hazard_pointer
+
+#endif // UTILITY_HAZARD_POINTER_HPP_INCLUDED
@@ -0,0 +1,176 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Incremental destruction of long chains of objects, on the thread that releases
+them.
+
+pointer_policy::destruct_chain_incrementally destructs only a limited number
+of objects in a chain at once, and "parks" the rest of the chain in a list
+local to the thread.
+The parked chains are destructed bit by bit when later chains of the same kind
+are released, and when collect() is called.
+This bounds the time that any one release takes.
+When the thread exits, all parked chains are destructed.
+*/
+
+#ifndef UTILITY_INCREMENTAL_DESTRUCTION_HPP_INCLUDED
+#define UTILITY_INCREMENTAL_DESTRUCTION_HPP_INCLUDED
+
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace utility { namespace incremental_destruction {
+
+    namespace detail {
+
+        /**
+        The rest of a chain that has been parked.
+        */
+        class parked_chain {
+        public:
+            parked_chain() noexcept : next (nullptr) {}
+            virtual ~parked_chain() noexcept {}
+
+            /**
+            Destruct objects from the chain, and subtract their number from
+            \a budget.
+            \return true iff the chain has been dealt with.
+            */
+            virtual bool resume (std::size_t & budget) noexcept = 0;
+
+            parked_chain * next;
+        };
+
+        template <class Pointer> class parked_pointer : public parked_chain {
+        public:
+            typedef Pointer (* release_type) (Pointer &&, std::size_t &);
+
+        private:
+            Pointer rest;
+            release_type release;
+
+        public:
+            parked_pointer (Pointer && rest, release_type release) noexcept
+            : rest (std::move (rest)), release (release) {}
+
+            bool resume (std::size_t & budget) noexcept override {
+                rest = release (std::move (rest), budget);
+                return rest.empty();
+            }
+        };
+
+        /**
+        List of chains that the current thread has parked, oldest first.
+        */
+        class parked_list {
+            parked_chain * first;
+            parked_chain * last;
+            std::size_t count;
+            bool collecting;
+
+        public:
+            parked_list() noexcept
+            : first (nullptr), last (nullptr), count (0), collecting (false) {}
+
+            /// Destruct all parked chains.
+            ~parked_list() noexcept {
+                collect (std::numeric_limits <std::size_t>::max());
+            }
+
+            static parked_list & current() {
+                static thread_local parked_list list;
+                return list;
+            }
+
+            void park (parked_chain * chain) noexcept {
+                if (last)
+                    last->next = chain;
+                else
+                    first = chain;
+                last = chain;
+                ++ count;
+            }
+
+            /**
+            Destruct up to \a budget objects from parked chains.
+            If this is called from a destructor that collect() calls, it does
+            nothing.
+            */
+            void collect (std::size_t budget) noexcept {
+                if (collecting)
+                    return;
+                collecting = true;
+                while (first && budget != 0) {
+                    if (!first->resume (budget))
+                        break;
+                    parked_chain * chain = first;
+                    first = chain->next;
+                    if (!first)
+                        last = nullptr;
+                    -- count;
+                    delete chain;
+                }
+                collecting = false;
+            }
+
+            std::size_t parked_count() const noexcept { return count; }
+        };
+
+    } // namespace detail
+
+    /**
+    Park \a rest, the rest of a chain, to be destructed later.
+    \param release
+        Function that destructs up to \a budget objects of a chain, subtracts
+        their number from \a budget, and returns the rest of the chain.
+    */
+    template <class Pointer> inline void park (Pointer && rest,
+        typename std::decay <Pointer>::type (* release) (
+            typename std::decay <Pointer>::type &&, std::size_t &))
+    {
+        typedef typename std::decay <Pointer>::type pointer_type;
+        // If this allocation fails, the program is terminated.
+        detail::parked_list::current().park (
+            new detail::parked_pointer <pointer_type> (
+                std::move (rest), release));
+    }
+
+    /**
+    Destruct up to \a budget objects from the chains that the current thread
+    has parked, oldest first.
+    */
+    inline void collect (std::size_t budget)
+    { detail::parked_list::current().collect (budget); }
+
+    /**
+    Destruct all objects in the chains that the current thread has parked.
+    */
+    inline void collect_all()
+    { collect (std::numeric_limits <std::size_t>::max()); }
+
+    /**
+    \return The number of chains that the current thread has parked and that
+    have not been destructed completely.
+    */
+    inline std::size_t parked_count()
+    { return detail::parked_list::current().parked_count(); }
+
+}} // namespace utility::incremental_destruction
+
+#endif // UTILITY_INCREMENTAL_DESTRUCTION_HPP_INCLUDED
@@ -0,0 +1,358 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Allocator for small objects that are often allocated by one thread and
+deallocated by another, as in a pipeline of producers and consumers.
+
+Each thread has a "heap" for each block size.
+A heap owns slabs of memory, and each slab records its heap, so that the heap
+that a block belongs to can be found from its address.
+Blocks that the owning thread deallocates go straight back into its free
+list, the "magazine", without any atomic operations.
+Blocks that other threads deallocate are collected in a batch in the
+deallocating thread, and the batch is pushed onto a lock-free "remote" list of
+the owning heap with one compare-and-swap.
+When the magazine of the owning thread is empty, it takes the whole remote list
+with one atomic exchange.
+
+Heaps are never destructed.
+When a thread exits, its heaps are marked unused, and they are taken over by
+threads that start later.
+Blocks that are deallocated in the meantime wait on the remote list.
+*/
+
+#ifndef UTILITY_MAGAZINE_ALLOCATOR_HPP_INCLUDED
+#define UTILITY_MAGAZINE_ALLOCATOR_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <atomic>
+
+namespace utility {
+
+    namespace magazine_allocator_detail {
+
+        /// The alignment of all blocks.
+        static constexpr std::size_t alignment = alignof (std::max_align_t);
+
+        /// The size of each slab, which is also its alignment.
+        static constexpr std::size_t slab_size = 64 * 1024;
+
+        /// The number of slabs that are allocated from the system at once.
+        static constexpr std::size_t slabs_per_chunk = 8;
+
+        /// The number of blocks for another thread that are batched.
+        static constexpr std::size_t batch_size = 32;
+
+        /// Objects larger than this are not allocated from a heap.
+        static constexpr std::size_t max_size = 256;
+
+        struct free_block { free_block * next; };
+
+        class heap;
+
+        /**
+        Header at the start of each slab.
+        For the first slab in a chunk, \c previous_chunk points to the chunk
+        that was allocated before, so that the chunks can be released.
+        */
+        struct slab_header {
+            heap * owner;
+            char * previous_chunk;
+        };
+
+        static constexpr std::size_t slab_header_size
+            = (sizeof (slab_header) + alignment - 1) / alignment * alignment;
+
+        /**
+        \return The heap that owns the slab that \a block is in.
+        */
+        inline heap * owner_of (void const * block) noexcept {
+            return reinterpret_cast <slab_header const *> (
+                reinterpret_cast <std::uintptr_t> (block)
+                & ~std::uintptr_t (slab_size - 1))->owner;
+        }
+
+        /// \return The first slab-aligned address in \a chunk.
+        inline char * first_slab (char * chunk) noexcept {
+            return reinterpret_cast <char *> (
+                (reinterpret_cast <std::uintptr_t> (chunk) + slab_size - 1)
+                & ~std::uintptr_t (slab_size - 1));
+        }
+
+        /**
+        Heap of blocks of one size.
+        Apart from the remote list, it is only used by the thread that owns
+        it.
+        */
+        class heap {
+            std::size_t block_size;
+
+            /// The magazine: blocks that the owning thread can hand out.
+            free_block * local;
+
+            /// The chunk that was allocated last.
+            char * last_chunk;
+            /// Slabs that have been allocated but not used yet.
+            char * next_slab;
+            std::size_t slabs_left;
+
+            /// Blocks for another heap, waiting to be sent to it.
+            heap * batch_owner;
+            free_block * batch_first;
+            free_block * batch_last;
+            std::size_t batch_count;
+
+            /// Blocks that other threads have deallocated.
+            std::atomic <free_block *> remote;
+
+        public:
+            std::atomic <bool> in_use;
+            heap * next;
+
+        private:
+            /**
+            Start using a new slab, and put its blocks in the magazine.
+            */
+            void add_slab() {
+                if (slabs_left == 0) {
+                    // Allocate one slab extra so that the slabs can be
+                    // aligned.
+                    char * chunk = static_cast <char *> (::operator new (
+                        (slabs_per_chunk + 1) * slab_size));
+                    next_slab = first_slab (chunk);
+                    slabs_left = slabs_per_chunk;
+                    reinterpret_cast <slab_header *> (next_slab)
+                        ->previous_chunk = last_chunk;
+                    last_chunk = chunk;
+                }
+                char * slab = next_slab;
+                next_slab += slab_size;
+                -- slabs_left;
+
+                reinterpret_cast <slab_header *> (slab)->owner = this;
+                char * blocks = slab + slab_header_size;
+                std::size_t block_num
+                    = (slab_size - slab_header_size) / block_size;
+                for (std::size_t i = block_num; i != 0; -- i) {
+                    free_block * block = reinterpret_cast <free_block *> (
+                        blocks + (i - 1) * block_size);
+                    block->next = local;
+                    local = block;
+                }
+            }
+
+        public:
+            explicit heap (std::size_t block_size) noexcept
+            : block_size (block_size), local (nullptr), last_chunk (nullptr),
+                next_slab (nullptr), slabs_left (0),
+                batch_owner (nullptr), batch_first (nullptr),
+                batch_last (nullptr), batch_count (0),
+                remote (nullptr), in_use (true), next (nullptr) {}
+
+            heap (heap const &) = delete;
+            heap & operator = (heap const &) = delete;
+
+            /**
+            Release all memory.
+            Heaps for threads are never destructed, because other threads
+            may still be using their blocks.
+            */
+            ~heap() noexcept {
+                while (last_chunk) {
+                    char * previous = reinterpret_cast <slab_header *> (
+                        first_slab (last_chunk))->previous_chunk;
+                    ::operator delete (last_chunk);
+                    last_chunk = previous;
+                }
+            }
+
+            void * allocate() {
+                if (!local) {
+                    local = remote.exchange (
+                        nullptr, std::memory_order_acquire);
+                    if (!local)
+                        add_slab();
+                }
+                free_block * block = local;
+                local = block->next;
+                return block;
+            }
+
+            void deallocate (void * memory) noexcept {
+                free_block * block = static_cast <free_block *> (memory);
+                heap * owner = owner_of (memory);
+                if (owner == this) {
+                    block->next = local;
+                    local = block;
+                    return;
+                }
+                if (owner != batch_owner)
+                    flush();
+                block->next = batch_first;
+                batch_first = block;
+                if (!batch_last)
+                    batch_last = block;
+                batch_owner = owner;
+                if (++ batch_count == batch_size)
+                    flush();
+            }
+
+            /**
+            Send the blocks that are waiting for another heap to it.
+            */
+            void flush() noexcept {
+                if (!batch_first)
+                    return;
+                std::atomic <free_block *> & target = batch_owner->remote;
+                free_block * old_first
+                    = target.load (std::memory_order_relaxed);
+                do
+                    batch_last->next = old_first;
+                while (!target.compare_exchange_weak (old_first, batch_first,
+                    std::memory_order_release, std::memory_order_relaxed));
+                batch_owner = nullptr;
+                batch_first = nullptr;
+                batch_last = nullptr;
+                batch_count = 0;
+            }
+        };
+
+        /**
+        Lock-free list of all heaps for one block size.
+        Heaps are only ever added, and are reused after a thread exits.
+        */
+        template <std::size_t BlockSize> class heap_list {
+            std::atomic <heap *> first;
+
+        public:
+            constexpr heap_list() noexcept : first (nullptr) {}
+
+            static heap_list & get() noexcept {
+                static heap_list instance;
+                return instance;
+            }
+
+            heap * claim() {
+                for (heap * h = first.load (std::memory_order_acquire); h;
+                    h = h->next)
+                {
+                    bool in_use = h->in_use.load (std::memory_order_relaxed);
+                    if (!in_use && h->in_use.compare_exchange_strong (
+                            in_use, true, std::memory_order_acquire))
+                        return h;
+                }
+                heap * h = new heap (BlockSize);
+                heap * old_first = first.load (std::memory_order_relaxed);
+                do
+                    h->next = old_first;
+                while (!first.compare_exchange_weak (old_first, h,
+                    std::memory_order_release, std::memory_order_relaxed));
+                return h;
+            }
+        };
+
+        /**
+        Owner of the heap for one block size for the current thread.
+        The heap is handed back when the thread exits.
+        */
+        template <std::size_t BlockSize> class heap_owner {
+        public:
+            heap * h;
+
+            heap_owner() : h (heap_list <BlockSize>::get().claim()) {}
+
+            ~heap_owner() noexcept {
+                h->flush();
+                h->in_use.store (false, std::memory_order_release);
+            }
+        };
+
+        template <std::size_t BlockSize> inline heap & current_heap() {
+            static thread_local heap_owner <BlockSize> owner;
+            return *owner.h;
+        }
+
+        template <class Type> struct heap_for {
+            static constexpr bool pooled = sizeof (Type) <= max_size
+                && alignof (Type) <= alignment;
+
+            static constexpr std::size_t block_size
+                = (sizeof (Type) + alignment - 1) / alignment * alignment;
+
+            static heap & current() { return current_heap <block_size>(); }
+        };
+
+    } // namespace magazine_allocator_detail
+
+    /**
+    Allocator for single objects that are often deallocated by another thread
+    than the one that allocated them.
+    Like pool_allocator, it is stateless, so that it does not make small_ptr
+    larger, and all instances compare equal.
+    Unlike pool_allocator, memory is always returned to the thread that
+    allocated it, so it does not accumulate in the consuming thread of a
+    pipeline.
+
+    A thread that deallocates a block for another thread may hold on to up to
+    32 blocks for each block size until it sends them in one go.
+    Objects must not be deallocated after the current thread's thread-local
+    objects have been destructed, for example in destructors of static
+    objects.
+
+    Arrays, objects larger than 256 bytes, and over-aligned objects are
+    allocated with ::operator new.
+    */
+    template <class Type> class magazine_allocator {
+    public:
+        typedef Type value_type;
+
+        magazine_allocator() noexcept {}
+
+        template <class Other>
+            magazine_allocator (magazine_allocator <Other> const &) noexcept {}
+
+        Type * allocate (std::size_t n) {
+            typedef magazine_allocator_detail::heap_for <Type> heap_for;
+            if (heap_for::pooled && n == 1)
+                return static_cast <Type *> (heap_for::current().allocate());
+            return static_cast <Type *> (::operator new (n * sizeof (Type)));
+        }
+
+        void deallocate (Type * object, std::size_t n) noexcept {
+            typedef magazine_allocator_detail::heap_for <Type> heap_for;
+            if (heap_for::pooled && n == 1)
+                heap_for::current().deallocate (object);
+            else
+                ::operator delete (object);
+        }
+    };
+
+    template <class Type1, class Type2>
+        inline bool operator == (magazine_allocator <Type1> const &,
+            magazine_allocator <Type2> const &) noexcept
+    { return true; }
+
+    template <class Type1, class Type2>
+        inline bool operator != (magazine_allocator <Type1> const &,
+            magazine_allocator <Type2> const &) noexcept
+    { return false; }
+
+} // namespace utility
+
+#endif // UTILITY_MAGAZINE_ALLOCATOR_HPP_INCLUDED
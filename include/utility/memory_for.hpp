@@ -0,0 +1,56 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef UTILITY_MEMORY_FOR_HPP_INCLUDED
+#define UTILITY_MEMORY_FOR_HPP_INCLUDED
+
+#include <type_traits>
+
+namespace utility {
+
+    namespace assignable_detail {
+
+        /**
+        Keep memory to keep an object, that allows sizeof, but do not initialise
+        the memory.
+        */
+        template <class Content> class memory_for {
+        public:
+            typedef typename std::aligned_storage <
+                sizeof (Content), alignof (Content)>::type memory_type;
+
+        private:
+            memory_type memory_;
+
+        public:
+            void * memory()
+            { return reinterpret_cast <void *> (&this->memory_); }
+
+            void const * memory() const
+            { return reinterpret_cast <void const *> (&this->memory_); }
+
+            Content * object()
+            { return reinterpret_cast <Content *> (memory()); }
+
+            Content const * object() const
+            { return reinterpret_cast <Content const *> (memory()); }
+        };
+
+    } // namespace assignable_detail
+
+} // namespace utility
+
+#endif // UTILITY_MEMORY_FOR_HPP_INCLUDED
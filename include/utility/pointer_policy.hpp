@@ -33,25 +33,61 @@ lifetime policy.
 By swapping some of these in and out, it must be possible to produce a fast and
 useful smart pointer for a specific purpose.
 
-\todo Check that unique_ptr and shared_ptr could be implemented in this
-framework.
+unique_owner implements unique ownership, like std::unique_ptr.
+
+\todo Check that shared_ptr could be implemented in this framework.
 */
 
 #ifndef UTILITY_POINTER_POLICY_HPP_INCLUDED
 #define UTILITY_POINTER_POLICY_HPP_INCLUDED
 
 #include <algorithm> // For std::swap
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <type_traits>
+#include <vector>
 #include <cassert>
 
 #include <boost/compressed_pair.hpp>
 
+#include "config.hpp"
 #include "shared.hpp"
+#include "biased_shared.hpp"
+#include "sharded_shared.hpp"
+#include "compact_shared.hpp"
+#include "deferred_release.hpp"
+#include "weak_shared.hpp"
+#include "epoch.hpp"
+#include "reclaimer.hpp"
+#include "incremental_destruction.hpp"
+#include "enable_if_compiles.hpp"
+#include "arena.hpp"
+#include "is_trivially_destructible.hpp"
+#include "memory_for.hpp"
+
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+#include "shared_instrumentation.hpp"
+#endif
 
 namespace utility { namespace pointer_policy {
 
     template <class ConstructType> struct construct_as {};
 
+    /**
+    Tag to construct a pointer that takes over a reference that has already
+    been acquired, instead of acquiring a new one.
+    */
+    struct adopt_reference {};
+
+    /**
+    Tag to construct a pointer with the first reference to an object that has
+    been owned without a reference count, for example by unique_owner.
+    */
+    struct adopt_unique {};
+
     /* Storage policies. */
 
     /**
@@ -80,6 +116,13 @@ namespace utility { namespace pointer_policy {
 
         void destruct() noexcept { delete pointer_; }
 
+        /**
+        \return Storage with a new copy of the object.
+        The object is copied as \a Type, even if it is of a derived type.
+        */
+        use_new_delete clone() const
+        { return use_new_delete (construct_as <Type>(), *pointer_); }
+
         void swap (use_new_delete & that) {
             using std::swap;
             swap (this->pointer_, that.pointer_);
@@ -100,8 +143,63 @@ namespace utility { namespace pointer_policy {
     and return a pointer.
     This provides strong exception-safety.
     If construction fails with an exception, the memory will be deallocated.
+
+    If \a Type needs more alignment than the allocator provides, like
+    utility::padded_shared does, then memory for characters is allocated
+    instead, with enough space to align the object.
+    The offset of the object is stored in the byte before it.
+    Such memory must be deallocated with deallocate().
     */
     template <class Type> class allocate_and_construct {
+        /// true iff Type needs more alignment than allocators provide.
+        static constexpr bool over_aligned
+            = alignof (Type) > alignof (std::max_align_t);
+
+        static_assert (alignof (Type) <= 256,
+            "The offset of over-aligned objects must fit in a byte.");
+
+        template <class Allocator> struct char_allocator {
+            typedef typename std::allocator_traits <Allocator>
+                ::template rebind_alloc <char> type;
+        };
+
+        static constexpr std::size_t over_aligned_size
+            = sizeof (Type) + alignof (Type);
+
+        template <class Allocator>
+            static Type * allocate (Allocator & allocator, std::false_type)
+        { return allocator.allocate (1); }
+
+        template <class Allocator>
+            static Type * allocate (Allocator & allocator, std::true_type)
+        {
+            typename char_allocator <Allocator>::type chars (allocator);
+            char * memory = chars.allocate (over_aligned_size);
+            // The offset is between 1 and alignof (Type), so there is always
+            // space to store it.
+            std::size_t offset = alignof (Type)
+                - reinterpret_cast <std::uintptr_t> (memory) % alignof (Type);
+            char * object = memory + offset;
+            object [-1] = static_cast <char> (offset - 1);
+            return reinterpret_cast <Type *> (object);
+        }
+
+        template <class Allocator>
+            static void deallocate (Allocator & allocator, Type * object,
+                std::false_type) noexcept
+        { allocator.deallocate (object, 1); }
+
+        template <class Allocator>
+            static void deallocate (Allocator & allocator, Type * object,
+                std::true_type) noexcept
+        {
+            typename char_allocator <Allocator>::type chars (allocator);
+            char * memory = reinterpret_cast <char *> (object);
+            std::size_t offset
+                = static_cast <unsigned char> (memory [-1]) + std::size_t (1);
+            chars.deallocate (memory - offset, over_aligned_size);
+        }
+
         /**
         Guard that deallocates memory if an exception is thrown.
         */
@@ -115,7 +213,7 @@ namespace utility { namespace pointer_policy {
 
             ~guard() noexcept {
                 if (set)
-                    allocator.deallocate (object, 1);
+                    deallocate (allocator, object);
             }
 
             void dismiss() noexcept { set = false; }
@@ -147,7 +245,7 @@ namespace utility { namespace pointer_policy {
             // Step 1: allocate memory.
             // This might fail with, say, std::bad_alloc, but then no memory
             // is leaked.
-            Type * object = allocator.allocate (1);
+            Type * object = allocate (allocator);
 
             // Step 2: construct the object.
             // But first tell our guard to deallocate the object if something
@@ -163,6 +261,27 @@ namespace utility { namespace pointer_policy {
             return object;
         }
 
+        /**
+        Allocate memory for an object of type Type, with the right alignment.
+        */
+        template <class Allocator>
+            static Type * allocate (Allocator & allocator)
+        {
+            return allocate (allocator,
+                std::integral_constant <bool, over_aligned>());
+        }
+
+        /**
+        Deallocate memory that allocate() has returned.
+        */
+        template <class Allocator>
+            static void deallocate (Allocator & allocator, Type * object)
+            noexcept
+        {
+            deallocate (allocator, object,
+                std::integral_constant <bool, over_aligned>());
+        }
+
         // With const allocator: copy the allocator.
         template <class Allocator, class ... Arguments>
             Type * operator() (
@@ -197,6 +316,8 @@ namespace utility { namespace pointer_policy {
         It is possible to call this on a pointer that another pointer already
         owns; sharing will work.
         Of course, the allocator must be the same.
+        If \a Type is over-aligned, the object must have been allocated with
+        allocate_and_construct.
         However, this would be a great opportunity for bugs.
         Instead, it is usually best to use \c construct.
         */
@@ -224,11 +345,35 @@ namespace utility { namespace pointer_policy {
 
         /**
         Destruct the object and release the memory.
+        If the object derives from utility::weak_shared, the memory is only
+        released if no weak references to it remain.
         Does not change the pointer.
         */
         void destruct() noexcept {
+            // The counts must be found while the object is alive.
+            weak_shared::counts * weak
+                = weak_shared_detail::counts_of_live (pointer_());
             pointer_()->~Type();
-            allocator_().deallocate (pointer_(), 1);
+            if (!weak || weak_shared::release_weak (weak))
+                deallocate();
+        }
+
+        /**
+        Release the memory without destructing the object.
+        This is used by weak pointers, once the object has been destructed.
+        */
+        void deallocate() noexcept {
+            allocate_and_construct <Type>::deallocate (
+                allocator_(), pointer_());
+        }
+
+        /**
+        \return Storage with a new copy of the object, allocated with the
+        same allocator.
+        */
+        use_allocator clone() const {
+            return use_allocator (
+                construct_as <Type>(), allocator_(), *pointer_());
         }
 
         void swap (use_allocator & that) noexcept {
@@ -262,223 +407,1549 @@ namespace utility { namespace pointer_policy {
         { return pointer_and_allocator_.second(); }
     };
 
-    // Dummy class.
-    struct move_recursive_next_not_available {};
-
     /**
-    Class that is default-constructed and called with a plain pointer
-    (<c>Type *</c>) by with_recursive_type.
-    It should return an rvalue reference to the smart pointer to the next object
-    in the chain.
-
-    Implement this for an object that is part of such a chain.
-    \code
-    template <> struct move_recursive_next <your_type> {
-        ..._ptr <your_type> operator() (your_type * object) const
-        { return object->next_; }
-    };
-    \endcode
-
-    The default implementation is empty, but derives from
-    move_recursive_next_not_available so this can be detected.
+    Storage policy like use_allocator, that also keeps a small tag in the
+    lowest bits of the pointer, which are always zero because of the
+    alignment of \a Type.
+    This way, a pointer and a few flags take as much space as a pointer.
+
+    object() and empty() ignore the tag, and so does strict_weak_ordered, which
+    compares the result of get().
+    The tag is copied and assigned with the pointer, and swapped with it.
+    Making the pointer empty does not change the tag.
+
+    \tparam TagBits
+        The number of bits in the tag, at most log2 (alignof (Type)).
     */
-    template <class Type> struct move_recursive_next
-    : move_recursive_next_not_available {};
+    template <class Type, class Allocator, unsigned TagBits>
+        class use_allocator_tagged
+    {
+        static constexpr std::uintptr_t tag_mask
+            = (std::uintptr_t (1) << TagBits) - 1;
 
-    /**
-    Storage policy that wraps another storage policy and deals with objects that
-    contain a pointer to an object of the same type.
-    An example are nodes in a linked list.
-    Normally, the pointer's destructor would indirectly call itself if a whole
-    string of objects needs to be destructed at once.
-    This can lead to stack overflows.
-    When this class is used as a storage policy, the recursion is essentially
-    turned into iteration.
-    Just before the node object's destructor is called, move_recursive_next is
-    called and the pointer to the next object is moved out.
-    Then the destructor is called, and then the next object is dealt with.
+    public:
+        typedef Type value_type;
+        typedef Allocator allocator_type;
+
+        /// The number of bits of the tag.
+        static constexpr unsigned tag_bits = TagBits;
 
-    This policy requires move_recursive_next to be specialised for the value
-    type.
-    */
-    template <class Storage> class with_recursive_type
-    : public Storage
-    {
     public:
+        use_allocator_tagged (Allocator const & allocator)
+        noexcept (noexcept (Allocator (allocator)))
+        : word_and_allocator_ (0, allocator) {}
+
+        /**
+        Construct with an object, which must have been allocated with
+        \c allocator, and a tag of 0.
+        */
+        use_allocator_tagged (Type * object, Allocator const & allocator)
+        noexcept (noexcept (Allocator (allocator)))
+        : word_and_allocator_ (
+            reinterpret_cast <std::uintptr_t> (object), allocator) {}
+
         template <class ... Arguments>
-        with_recursive_type (Arguments && ... arguments)
-        noexcept (noexcept (Storage (std::forward <Arguments> (arguments) ...)))
-        : Storage (std::forward <Arguments> (arguments) ...)
-        {}
+        use_allocator_tagged (construct_as <Type>,
+            Allocator const & allocator, Arguments && ... arguments)
+        : word_and_allocator_ (reinterpret_cast <std::uintptr_t> (
+                allocate_and_construct <Type>() (
+                    allocator, std::forward <Arguments> (arguments) ...)),
+            allocator) {}
 
         // Use default copy, move, copy assignment, and move assignment.
         // Use default destructor.
 
     protected:
-        void destruct() noexcept {
-            // Deal with the chain following this object.
-            move_recursive_next <typename Storage::value_type> move_next;
-            auto && next = move_next (Storage::object());
-            typedef typename std::decay <decltype (next)>::type pointer_type;
-            if (!next.empty())
-                pointer_type::release_chain (std::move (next));
+        Type * object() const {
+            // This is checked here, since Type may be incomplete when the
+            // class is instantiated.
+            static_assert ((std::size_t (1) << TagBits) <= alignof (Type),
+                "The alignment of Type leaves too few bits for the tag.");
+            return reinterpret_cast <Type *> (word_() & ~tag_mask);
+        }
 
-            // Destruct this object (with the pointer to the next object set
-            // to null.)
-            Storage::destruct();
+        /**
+        Make the pointer empty, but keep the tag.
+        Does not destruct the object.
+        */
+        void reset() noexcept { word_() &= tag_mask; }
 
-            // Static check.
-            static_assert (
-                std::is_base_of <with_recursive_type, pointer_type>::value,
-                "move_recursive_next should return the same type as this.");
+        /**
+        Destruct the object and release the memory, as use_allocator does.
+        Does not change the pointer.
+        */
+        void destruct() noexcept {
+            Type * object = this->object();
+            weak_shared::counts * weak
+                = weak_shared_detail::counts_of_live (object);
+            object->~Type();
+            if (!weak || weak_shared::release_weak (weak))
+                deallocate();
         }
 
-        with_recursive_type & operator= (with_recursive_type const & that) {
-            Storage::operator= (that);
-            return *this;
+        void deallocate() noexcept {
+            allocate_and_construct <Type>::deallocate (allocator_(), object());
         }
 
-        with_recursive_type & operator= (with_recursive_type && that) {
-            Storage::operator= (std::move (that));
-            return *this;
+        /**
+        \return Storage with a new copy of the object, allocated with the
+        same allocator, and with the same tag.
+        */
+        use_allocator_tagged clone() const {
+            use_allocator_tagged result (
+                construct_as <Type>(), allocator_(), *object());
+            result.set_tag (tag());
+            return result;
         }
-    };
 
-    /* Lifetime policies. */
+        void swap (use_allocator_tagged & that) noexcept {
+            using std::swap;
+            swap (this->word_and_allocator_, that.word_and_allocator_);
+        }
 
-    /**
-    Reference counting policy that uses intrusive reference counting.
-    The contained object must be derived from shared.
-    */
-    template <class Storage> class reference_count_shared
-    : public Storage
-    {
     public:
-        template <class ... Arguments>
-        reference_count_shared (Arguments && ... arguments)
-        noexcept (noexcept (Storage (std::forward <Arguments> (arguments) ...)))
-        : Storage (std::forward <Arguments> (arguments) ...)
-        {
-            static_assert (
-                std::is_base_of <shared, typename Storage::value_type>::value,
-                "The referenced object must derive from utility::shared.");
-            acquire();
-        }
+        /**
+        \return true iff this owns an object.
+        */
+        bool empty() const { return object() == nullptr; }
 
         /**
-        Copy-construct from another pointer.
-        This increases the use count on the underlying object.
+        \return The allocator used for the memory for the object.
         */
-        reference_count_shared (reference_count_shared const & that) noexcept
-        : Storage (that)
-        { acquire(); }
+        Allocator const & allocator() const
+        { return allocator_(); }
 
         /**
-        Move-construct from another pointer.
-        Afterwards, the original pointer will be empty.
-        No atomic operations are used.
+        \return The tag.
         */
-        reference_count_shared (reference_count_shared && that)
-        noexcept (noexcept (Storage (std::declval <Storage &&>())))
-        : Storage (std::move (that))
-        {
-            static_assert (noexcept (that.Storage::reset()), "By definition");
-            that.Storage::reset();
-        }
+        unsigned tag() const { return unsigned (word_() & tag_mask); }
 
-        reference_count_shared & operator= (
-            reference_count_shared const & that)
-        {
-            // Save and acquire "that" in case releasing the object in "this"
-            // releases that.
-            // This can happen in a linked list, or if this == &that.
-            that.acquire();
-            Storage save = that;
-            release();
-            Storage::operator= (save);
-            return *this;
-        }
+        /**
+        Set the tag to the lowest \a TagBits bits of \a tag.
+        This only changes this pointer, not other pointers to the same object.
+        */
+        void set_tag (unsigned tag)
+        { word_() = (word_() & ~tag_mask) | (std::uintptr_t (tag) & tag_mask); }
 
-        reference_count_shared & operator= (reference_count_shared && that) {
-            Storage save = std::move (that);
-            that.Storage::reset();
-            release();
-            Storage::operator= (std::move (save));
-            return *this;
-        }
+    private:
+        boost::compressed_pair <std::uintptr_t, Allocator> word_and_allocator_;
+
+        std::uintptr_t & word_()
+        { return word_and_allocator_.first(); }
+        std::uintptr_t word_() const
+        { return word_and_allocator_.first(); }
+
+        Allocator & allocator_()
+        { return word_and_allocator_.second(); }
+        Allocator const & allocator_() const
+        { return word_and_allocator_.second(); }
+    };
 
-        ~reference_count_shared() noexcept { release(); }
+    /**
+    Storage policy that keeps a pointer to an object in a utility::arena.
+    The memory is never deallocated through the pointer: it is released with
+    the arena.
+    destruct() only calls the destructor, and not even that if \a Type is
+    trivially destructible.
+    All pointers must therefore be destructed before the arena is rewound or
+    released.
+    If construction fails with an exception, the memory remains in the arena
+    until then.
+    */
+    template <class Type> class use_arena {
+    public:
+        typedef Type value_type;
+
+    public:
+        use_arena() noexcept : pointer_ (nullptr) {}
 
         /**
-        \return The number of objects owning the object this owns.
-        0 if this is empty.
+        Construct with an object in an arena.
         */
-        long use_count() const {
-            if (!Storage::empty())
-                return shared::get_count (Storage::object());
-            else
-                return 0;
+        explicit use_arena (Type * object) noexcept : pointer_ (object) {}
+
+        template <class ... Arguments>
+        use_arena (construct_as <Type>, arena & a, Arguments && ... arguments)
+        : pointer_ (new (a.allocate (sizeof (Type), alignof (Type)))
+            Type (std::forward <Arguments> (arguments) ...)) {}
+
+        // Use default copy, move, copy assignment, and move assignment.
+        // Use default destructor.
+
+    protected:
+        Type * object() const { return pointer_; }
+
+        void reset() noexcept { pointer_ = nullptr; }
+
+        void destruct() noexcept
+        { destruct (utility::is_trivially_destructible <Type>()); }
+
+        void swap (use_arena & that) noexcept {
+            using std::swap;
+            swap (this->pointer_, that.pointer_);
         }
 
+    public:
         /**
-        \return true iff this is the only owner of the object.
-        If this is empty, return false.
+        \return true iff this owns an object.
         */
-        bool unique() const { return use_count() == 1; }
+        bool empty() const { return pointer_ == nullptr; }
 
     private:
-        void acquire() const noexcept {
-            if (!Storage::empty())
-                shared::acquire (Storage::object());
-        }
+        Type * pointer_;
 
-        void release() noexcept {
-            if (!Storage::empty()
-                    && shared::release_count (Storage::object()))
-                Storage::destruct();
-        }
+        void destruct (std::true_type) noexcept {}
+        void destruct (std::false_type) noexcept { pointer_->~Type(); }
+    };
 
-        template <class Storage2> friend class with_recursive_type;
+    /**
+    Storage policy that keeps a 32-bit index of an object in a region, such as
+    utility::compact_region, instead of a pointer.
+    Index 0 means that this is empty.
+
+    \tparam Region
+        A class with static functions \c allocate (size) and
+        \c deallocate (memory, size), and \c index_of (object) and
+        \c address_of (index) that convert between addresses and indices.
+        Its static constants \c max_block_size and \c granularity give the
+        largest size and alignment of objects in it.
+    */
+    template <class Type, class Region> class use_region_index {
+    public:
+        typedef Type value_type;
 
+    private:
         /**
-        Release a chain of objects iteratively.
-        Useful when recursive destruction might cause stack overflows.
+        Check that objects of type Type fit in the region.
+        This is called from member functions, since Type may be incomplete
+        when the class is instantiated.
+        */
+        static void check_type() noexcept {
+            static_assert (sizeof (Type) <= Region::max_block_size,
+                "Type is too large for the region.");
+            static_assert (alignof (Type) <= Region::granularity,
+                "Over-aligned types are not supported.");
+        }
 
-        Move the pointer to the next object out before destructing the current
-        object.
-        Do this to each object in the chain, until the object is shared.
+    public:
+        use_region_index() noexcept : index_ (0) {}
 
-        \pre !p.empty()
+        /**
+        Construct with an object, which must have been allocated in the
+        region.
         */
-        template <class Pointer, class Enable = typename boost::enable_if <
-            std::is_base_of <reference_count_shared, Pointer>>::type>
-        static void release_chain (Pointer && p) noexcept
-        {
-            Pointer current = std::move (p);
-            move_recursive_next <typename Storage::value_type> move_next;
+        explicit use_region_index (Type * object) noexcept
+        : index_ (object ? Region::index_of (object) : 0) {}
 
-            // "current" will be manually destructed if necessary.
-            assert (!current.empty());
-            do {
-                bool must_be_destructed
-                    = shared::release_count (current.object());
+        template <class ... Arguments>
+        use_region_index (construct_as <Type>, Arguments && ... arguments)
+        : index_ (0)
+        {
+            check_type();
+            void * memory = Region::allocate (sizeof (Type));
+            try {
+                new (memory) Type (std::forward <Arguments> (arguments) ...);
+            } catch (...) {
+                Region::deallocate (memory, sizeof (Type));
+                throw;
+            }
+            index_ = Region::index_of (memory);
+        }
+
+        // Use default copy, move, copy assignment, and move assignment.
+        // Use default destructor.
+
+    protected:
+        Type * object() const {
+            return index_ ? static_cast <Type *> (Region::address_of (index_))
+                : nullptr;
+        }
+
+        void reset() noexcept { index_ = 0; }
+
+        void destruct() noexcept {
+            check_type();
+            Type * object = this->object();
+            object->~Type();
+            Region::deallocate (object, sizeof (Type));
+        }
+
+        /// \return Storage with a new copy of the object in the region.
+        use_region_index clone() const
+        { return use_region_index (construct_as <Type>(), *object()); }
+
+        void swap (use_region_index & that) noexcept {
+            using std::swap;
+            swap (this->index_, that.index_);
+        }
+
+    public:
+        /**
+        \return true iff this owns an object.
+        */
+        bool empty() const { return index_ == 0; }
+
+    private:
+        std::uint32_t index_;
+    };
+
+    /**
+    Header with a reference count that use_allocator_with_count puts right
+    before the object.
+    */
+    struct count_prefix {
+        std::atomic <long> count;
+
+        count_prefix() noexcept : count (0l) {}
+    };
+
+    /**
+    Layout of the memory that use_allocator_with_count allocates for an
+    object of type \a Type: a count_prefix, and then the object.
+    */
+    template <class Type> struct count_prefix_layout {
+        /// The offset of the object from the start of the block.
+        static constexpr std::size_t object_offset
+            = (sizeof (count_prefix) + alignof (Type) - 1)
+                / alignof (Type) * alignof (Type);
+
+        static constexpr std::size_t alignment
+            = alignof (Type) > alignof (count_prefix)
+                ? alignof (Type) : alignof (count_prefix);
+
+        typedef typename std::aligned_storage <
+            object_offset + sizeof (Type), alignment>::type block;
+
+        static count_prefix * prefix_of (Type const * object) noexcept {
+            return reinterpret_cast <count_prefix *> (
+                reinterpret_cast <char *> (const_cast <Type *> (object))
+                - object_offset);
+        }
+
+        static block * block_of (Type * object) noexcept {
+            return reinterpret_cast <block *> (
+                reinterpret_cast <char *> (object) - object_offset);
+        }
+    };
+
+    template <class Type> constexpr std::size_t
+        count_prefix_layout <Type>::object_offset;
+    template <class Type> constexpr std::size_t
+        count_prefix_layout <Type>::alignment;
+
+    /**
+    Storage policy like use_allocator, but which allocates a count_prefix
+    right before the object, in the same allocation.
+    The allocator is rebound to allocate the whole block.
+    This allows reference_count_prefix to count references to objects of any
+    type, while the pointer holds only a pointer to the object.
+    */
+    template <class Type, class Allocator> class use_allocator_with_count {
+        // Type may be incomplete when this class is instantiated, so the
+        // layout is only used in member functions.
+        typedef count_prefix_layout <Type> layout;
+
+    public:
+        typedef Type value_type;
+        typedef Allocator allocator_type;
+
+    public:
+        use_allocator_with_count (Allocator const & allocator)
+        noexcept (noexcept (Allocator (allocator)))
+        : pointer_and_allocator_ (nullptr, allocator) {}
+
+        template <class ... Arguments>
+        use_allocator_with_count (construct_as <Type>,
+            Allocator const & allocator, Arguments && ... arguments)
+        : pointer_and_allocator_ (
+            construct (allocator, std::forward <Arguments> (arguments) ...),
+            allocator) {}
+
+        // Use default copy, move, copy assignment, and move assignment.
+        // Use default destructor.
+
+    protected:
+        Type * object() const { return pointer_(); }
+
+        /**
+        Make the pointer empty.
+        Does not destruct the object.
+        */
+        void reset() noexcept { pointer_() = nullptr; }
+
+        /**
+        Destruct the object and the count, and release the memory.
+        Does not change the pointer.
+        */
+        void destruct() noexcept {
+            Type * object = pointer_();
+            object->~Type();
+            layout::prefix_of (object)->~count_prefix();
+            typedef typename layout::block block;
+            typename std::allocator_traits <Allocator>
+                ::template rebind_alloc <block> blocks (allocator_());
+            allocate_and_construct <block>::deallocate (
+                blocks, layout::block_of (object));
+        }
+
+        /**
+        \return Storage with a new copy of the object, allocated with the
+        same allocator.
+        */
+        use_allocator_with_count clone() const {
+            return use_allocator_with_count (
+                construct_as <Type>(), allocator_(), *pointer_());
+        }
+
+        void swap (use_allocator_with_count & that) noexcept {
+            using std::swap;
+            swap (this->pointer_and_allocator_, that.pointer_and_allocator_);
+        }
+
+    public:
+        /**
+        \return true iff this owns an object.
+        */
+        bool empty() const { return pointer_() == nullptr; }
+
+        /**
+        \return The allocator used for the memory for the object.
+        */
+        Allocator const & allocator() const
+        { return allocator_(); }
+
+    private:
+        boost::compressed_pair <Type *, Allocator> pointer_and_allocator_;
+
+        template <class ... Arguments>
+            static Type * construct (
+                Allocator const & allocator, Arguments && ... arguments)
+        {
+            typedef typename layout::block block;
+            typename std::allocator_traits <Allocator>
+                ::template rebind_alloc <block> blocks (allocator);
+            char * memory = reinterpret_cast <char *> (
+                allocate_and_construct <block>::allocate (blocks));
+            new (memory) count_prefix();
+            try {
+                return new (memory + layout::object_offset)
+                    Type (std::forward <Arguments> (arguments) ...);
+            } catch (...) {
+                allocate_and_construct <block>::deallocate (
+                    blocks, reinterpret_cast <block *> (memory));
+                throw;
+            }
+        }
+
+        Type * & pointer_()
+        { return pointer_and_allocator_.first(); }
+        Type * pointer_() const
+        { return pointer_and_allocator_.first(); }
+
+        Allocator & allocator_()
+        { return pointer_and_allocator_.second(); }
+        Allocator const & allocator_() const
+        { return pointer_and_allocator_.second(); }
+    };
+
+    // Dummy class.
+    struct move_recursive_next_not_available {};
+
+    /**
+    Class that is default-constructed and called with a plain pointer
+    (<c>Type *</c>) by with_recursive_type.
+    It should return an rvalue reference to the smart pointer to the next object
+    in the chain.
+
+    Implement this for an object that is part of such a chain.
+    \code
+    template <> struct move_recursive_next <your_type> {
+        ..._ptr <your_type> operator() (your_type * object) const
+        { return object->next_; }
+    };
+    \endcode
+
+    The default implementation is empty, but derives from
+    move_recursive_next_not_available so this can be detected.
+    */
+    template <class Type> struct move_recursive_next
+    : move_recursive_next_not_available {};
+
+    /**
+    Policy for with_recursive_type that destructs a whole chain of objects
+    at once.
+    This is the default.
+    */
+    struct destruct_chain {
+        /// \return The maximum number of objects to destruct at once.
+        static std::size_t budget() noexcept
+        { return std::numeric_limits <std::size_t>::max(); }
+
+        /**
+        Called after up to budget() objects in a chain have been destructed,
+        with the rest of the chain, which may be empty; the part of the budget
+        that has not been used; and a function that destructs up to
+        \c budget objects of a chain, subtracts their number from \c budget,
+        and returns the rest of the chain.
+        With an unlimited budget, the rest of the chain is always empty.
+        */
+        template <class Pointer, class Release>
+            static void finish (Pointer &&, std::size_t, Release) noexcept
+        {}
+    };
+
+    /**
+    Policy for with_recursive_type that destructs up to \a Threshold objects
+    in a chain on the thread that releases it, and hands the rest of the chain
+    to utility::reclaimer, which destructs it on a background thread.
+    Call utility::reclaimer::drain() to wait until it has finished.
+
+    Destructors of objects in the chain may then run on the reclaimer thread.
+    */
+    template <std::size_t Threshold> struct destruct_chain_in_background {
+        static std::size_t budget() noexcept {
+            return reclaimer::on_reclaimer_thread()
+                ? std::numeric_limits <std::size_t>::max() : Threshold;
+        }
+
+        template <class Pointer, class Release>
+            static void finish (Pointer && rest, std::size_t, Release)
+            noexcept
+        {
+            if (!rest.empty())
+                reclaimer::post (std::move (rest));
+        }
+    };
+
+    /**
+    Policy for with_recursive_type that destructs up to \a Budget objects in
+    a chain at once, so that the latency of any one release is bounded.
+    The rest of the chain is parked in a list local to the thread, with
+    utility::incremental_destruction.
+    If a release does not use its whole budget, it uses the rest to destruct
+    parked chains.
+    incremental_destruction::collect() can be called to destruct parked chains
+    explicitly, for example when the thread is idle.
+    */
+    template <std::size_t Budget> struct destruct_chain_incrementally {
+        static std::size_t budget() noexcept { return Budget; }
+
+        template <class Pointer, class Release>
+            static void finish (Pointer && rest, std::size_t budget,
+                Release release) noexcept
+        {
+            if (!rest.empty())
+                incremental_destruction::park (std::move (rest), release);
+            else if (budget != 0)
+                incremental_destruction::collect (budget);
+        }
+    };
+
+    /**
+    The policy with which with_recursive_type destructs chains of objects of
+    type \a Type.
+    This is move_recursive_next <Type>::destruction if that exists, and
+    destruct_chain otherwise.
+    */
+    template <class Type, class Enable = void> struct chain_destruction
+    { typedef destruct_chain type; };
+
+    template <class Type> struct chain_destruction <Type,
+        typename utility::enable_if_compiles <
+            typename move_recursive_next <Type>::destruction>::type>
+    { typedef typename move_recursive_next <Type>::destruction type; };
+
+    /**
+    Storage policy that wraps another storage policy and deals with objects that
+    contain a pointer to an object of the same type.
+    An example are nodes in a linked list.
+    Normally, the pointer's destructor would indirectly call itself if a whole
+    string of objects needs to be destructed at once.
+    This can lead to stack overflows.
+    When this class is used as a storage policy, the recursion is essentially
+    turned into iteration.
+    Just before the node object's destructor is called, move_recursive_next is
+    called and the pointer to the next object is moved out.
+    Then the destructor is called, and then the next object is dealt with.
+
+    This policy requires move_recursive_next to be specialised for the value
+    type.
+
+    By default, the whole chain is destructed at once.
+    To destruct only part of a long chain on the releasing thread, the
+    specialisation of move_recursive_next can define a typedef
+    \c destruction, for example to destruct_chain_in_background or
+    destruct_chain_incrementally.
+    \code
+    template <> struct move_recursive_next <your_type> {
+        typedef destruct_chain_in_background <1000> destruction;
+        ...
+    };
+    \endcode
+    */
+    template <class Storage> class with_recursive_type
+    : public Storage
+    {
+    public:
+        template <class ... Arguments>
+        with_recursive_type (Arguments && ... arguments)
+        noexcept (noexcept (Storage (std::forward <Arguments> (arguments) ...)))
+        : Storage (std::forward <Arguments> (arguments) ...)
+        {}
+
+        // The assignment operators below would suppress the implicit copy
+        // constructor.
+        with_recursive_type (with_recursive_type const &) = default;
+        with_recursive_type (with_recursive_type &&) = default;
+
+        // Use default destructor.
+
+    protected:
+        void destruct() noexcept {
+            // Deal with the chain following this object.
+            move_recursive_next <typename Storage::value_type> move_next;
+            auto && next = move_next (Storage::object());
+            typedef typename std::decay <decltype (next)>::type pointer_type;
+            if (!next.empty()) {
+                typedef typename chain_destruction <
+                    typename Storage::value_type>::type destruction;
+                std::size_t budget = destruction::budget();
+                pointer_type rest = pointer_type::release_chain (
+                    std::move (next), budget);
+                destruction::finish (std::move (rest), budget,
+                    &release_chain <pointer_type>);
+            }
+
+            // Destruct this object (with the pointer to the next object set
+            // to null.)
+            Storage::destruct();
+
+            // Static check.
+            static_assert (
+                std::is_base_of <with_recursive_type, pointer_type>::value,
+                "move_recursive_next should return the same type as this.");
+        }
+
+        with_recursive_type & operator= (with_recursive_type const & that) {
+            Storage::operator= (that);
+            return *this;
+        }
+
+        with_recursive_type & operator= (with_recursive_type && that) {
+            Storage::operator= (std::move (that));
+            return *this;
+        }
+
+    private:
+        /**
+        Forward to the lifetime policy's release_chain, which is private, so
+        that the destruction policy can resume the chain later.
+        */
+        template <class Pointer>
+            static Pointer release_chain (Pointer && p, std::size_t & budget)
+            noexcept
+        { return Pointer::release_chain (std::move (p), budget); }
+    };
+
+    // Dummy class.
+    struct move_recursive_children_not_available {};
+
+    /**
+    Class that is default-constructed and called by with_recursive_children
+    with a plain pointer (<c>Type *</c>) and a visitor.
+    It should call the visitor with an rvalue reference to each smart pointer
+    to a child of the object.
+
+    Implement this for an object in a tree or a directed acyclic graph.
+    \code
+    template <> struct move_recursive_children <your_type> {
+        template <class Visitor>
+            void operator() (your_type * object, Visitor && visit) const
+        {
+            visit (std::move (object->left_));
+            visit (std::move (object->right_));
+        }
+    };
+    \endcode
+
+    The default implementation is empty, but derives from
+    move_recursive_children_not_available so this can be detected.
+    */
+    template <class Type> struct move_recursive_children
+    : move_recursive_children_not_available {};
+
+    /**
+    Storage policy like with_recursive_type, but for objects that contain any
+    number of pointers to objects of the same type, like nodes in a tree.
+    Instead of recursing, the lifetime policy destructs the subtree of each
+    child iteratively, with a stack of pointers on the heap.
+    Children that are shared with other owners, as in a directed acyclic
+    graph, are only released, just like for with_recursive_type.
+    If the stack cannot grow, the program is terminated.
+
+    This policy requires move_recursive_children to be specialised for the
+    value type.
+    */
+    template <class Storage> class with_recursive_children
+    : public Storage
+    {
+    public:
+        template <class ... Arguments>
+        with_recursive_children (Arguments && ... arguments)
+        noexcept (noexcept (Storage (std::forward <Arguments> (arguments) ...)))
+        : Storage (std::forward <Arguments> (arguments) ...)
+        {}
+
+        // The assignment operators below would suppress the implicit copy
+        // constructor.
+        with_recursive_children (with_recursive_children const &) = default;
+        with_recursive_children (with_recursive_children &&) = default;
+
+        // Use default destructor.
+
+    protected:
+        void destruct() noexcept {
+            // Deal with the subtrees under this object.
+            move_recursive_children <typename Storage::value_type>
+                move_children;
+            move_children (Storage::object(), release_child());
+
+            // Destruct this object (with the pointers to its children set to
+            // null.)
+            Storage::destruct();
+        }
+
+        with_recursive_children & operator= (
+            with_recursive_children const & that)
+        {
+            Storage::operator= (that);
+            return *this;
+        }
+
+        with_recursive_children & operator= (with_recursive_children && that)
+        {
+            Storage::operator= (std::move (that));
+            return *this;
+        }
+
+    private:
+        struct release_child {
+            template <class Pointer>
+                void operator() (Pointer && child) const noexcept
+            {
+                typedef typename std::decay <Pointer>::type pointer_type;
+                static_assert (std::is_base_of <
+                        with_recursive_children, pointer_type>::value,
+                    "move_recursive_children should pass pointers of the same "
+                    "type as this.");
+                if (!child.empty())
+                    pointer_type::release_tree (std::move (child));
+            }
+        };
+    };
+
+    /* Lifetime policies. */
+
+    /**
+    Reference counting policy that uses intrusive reference counting.
+    \a Count provides static functions \c acquire, \c release_count, and
+    \c get_count that take a pointer to the contained object, like
+    shared_count.
+    The derived class should check that the contained object derives from the
+    right class.
+    This implements reference_count_shared and reference_count_local.
+    */
+    template <class Storage, class Count> class intrusive_reference_count
+    : public Storage
+    {
+    public:
+        template <class ... Arguments>
+        intrusive_reference_count (Arguments && ... arguments)
+        noexcept (noexcept (Storage (std::forward <Arguments> (arguments) ...)))
+        : Storage (std::forward <Arguments> (arguments) ...)
+        { acquire(); }
+
+        /**
+        Construct with a reference that the caller has already acquired.
+        */
+        template <class ... Arguments>
+        intrusive_reference_count (adopt_reference,
+            Arguments && ... arguments)
+        noexcept (noexcept (Storage (std::forward <Arguments> (arguments) ...)))
+        : Storage (std::forward <Arguments> (arguments) ...) {}
+
+        /**
+        Construct with an object that has been owned without a reference
+        count, and whose count is therefore zero.
+        This uses Count::acquire_first, which can be cheaper than acquire.
+        */
+        template <class ... Arguments>
+        intrusive_reference_count (adopt_unique, Arguments && ... arguments)
+        noexcept (noexcept (Storage (std::forward <Arguments> (arguments) ...)))
+        : Storage (std::forward <Arguments> (arguments) ...)
+        {
+            if (!Storage::empty()) {
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+                shared_instrumentation::on_construct <
+                    typename Storage::value_type>();
+                shared_instrumentation::on_acquire <
+                    typename Storage::value_type>();
+#endif
+                Count::acquire_first (Storage::object());
+            }
+        }
+
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+        /**
+        Construct a new object, and count it as live.
+        */
+        template <class ConstructType, class ... Arguments>
+        intrusive_reference_count (construct_as <ConstructType> tag,
+            Arguments && ... arguments)
+        : Storage (tag, std::forward <Arguments> (arguments) ...)
+        {
+            shared_instrumentation::on_construct <
+                typename Storage::value_type>();
+            acquire();
+        }
+#endif
+
+        /**
+        Copy-construct from another pointer.
+        This increases the use count on the underlying object.
+        */
+        intrusive_reference_count (intrusive_reference_count const & that)
+        noexcept
+        : Storage (that)
+        { acquire(); }
+
+        /**
+        Move-construct from another pointer.
+        Afterwards, the original pointer will be empty.
+        No atomic operations are used.
+        */
+        intrusive_reference_count (intrusive_reference_count && that)
+        noexcept (noexcept (Storage (std::declval <Storage &&>())))
+        : Storage (std::move (that))
+        {
+            static_assert (noexcept (that.Storage::reset()), "By definition");
+            that.Storage::reset();
+        }
+
+        intrusive_reference_count & operator= (
+            intrusive_reference_count const & that)
+        {
+            // Save and acquire "that" in case releasing the object in "this"
+            // releases that.
+            // This can happen in a linked list, or if this == &that.
+            that.acquire();
+            Storage save = that;
+            release();
+            Storage::operator= (save);
+            return *this;
+        }
+
+        intrusive_reference_count & operator= (
+            intrusive_reference_count && that)
+        {
+            Storage save = std::move (that);
+            that.Storage::reset();
+            release();
+            Storage::operator= (std::move (save));
+            return *this;
+        }
+
+        ~intrusive_reference_count() noexcept { release(); }
+
+        /**
+        \return The number of objects owning the object this owns.
+        0 if this is empty.
+        */
+        long use_count() const {
+            if (!Storage::empty())
+                return Count::get_count (Storage::object());
+            else
+                return 0;
+        }
+
+        /**
+        \return true iff this is the only owner of the object.
+        If this is empty, return false.
+        */
+        bool unique() const { return use_count() == 1; }
+
+    private:
+        void acquire() const noexcept {
+            if (!Storage::empty()) {
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+                shared_instrumentation::on_acquire <
+                    typename Storage::value_type>();
+#endif
+                Count::acquire (Storage::object());
+            }
+        }
+
+        void release() noexcept {
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+            if (!Storage::empty())
+                shared_instrumentation::on_release <
+                    typename Storage::value_type>();
+#endif
+            if (!Storage::empty() && Count::release_count (
+                    Storage::object(), static_cast <Storage const &> (*this)))
+            {
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+                shared_instrumentation::on_destruct <
+                    typename Storage::value_type>();
+#endif
+                Storage::destruct();
+            }
+        }
+
+        template <class Storage2> friend class with_recursive_type;
+        template <class Storage2> friend class with_recursive_children;
+
+        /**
+        Release a chain of objects iteratively.
+        Useful when recursive destruction might cause stack overflows.
+
+        Move the pointer to the next object out before destructing the current
+        object.
+        Do this to each object in the chain, until the object is shared, or
+        until \a budget objects have been destructed.
+        \a budget is decreased by the number of objects destructed.
+
+        \return The rest of the chain, which holds a reference that has not
+        been released yet, or an empty pointer if the whole chain has been
+        dealt with.
+        */
+        template <class Pointer, class Enable = typename boost::enable_if <
+            std::is_base_of <intrusive_reference_count, Pointer>>::type>
+        static Pointer release_chain (Pointer && p, std::size_t & budget)
+            noexcept
+        {
+            Pointer current = std::move (p);
+            move_recursive_next <typename Storage::value_type> move_next;
+
+            // "current" will be manually destructed if necessary.
+            for (; !current.empty() && budget != 0; -- budget) {
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+                shared_instrumentation::on_release <
+                    typename Storage::value_type>();
+#endif
+                bool must_be_destructed = Count::release_count (
+                    current.object(), static_cast <Storage const &> (current));
 
                 if (!must_be_destructed) {
                     // Reset the pointer ...
                     current.reset();
                     // ...  because here it goes out of scope, and that would
                     // decrease the use count again.
-                    return;
+                    break;
                 }
 
                 auto next = move_next (current.object());
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+                shared_instrumentation::on_destruct <
+                    typename Storage::value_type>();
+#endif
                 current.destruct();
                 // Reset the pointer ...
                 current.reset();
                 // ... because otherwise the use count will be decreased again
                 // here.
                 current = std::move (next);
-            } while (!current.empty());
+            }
+            return current;
+        }
+
+        /**
+        Release a tree of objects iteratively, with a stack on the heap.
+        The children of each object are moved out with
+        move_recursive_children before the object is destructed.
+        Subtrees whose root is shared are not descended into.
+
+        \pre !p.empty()
+        */
+        template <class Pointer, class Enable = typename boost::enable_if <
+            std::is_base_of <intrusive_reference_count, Pointer>>::type>
+        static void release_tree (Pointer && p) noexcept
+        {
+            move_recursive_children <typename Storage::value_type>
+                move_children;
+            // If this allocation fails, the program is terminated.
+            std::vector <Pointer> stack;
+            stack.push_back (std::move (p));
+
+            while (!stack.empty()) {
+                Pointer current = std::move (stack.back());
+                stack.pop_back();
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+                shared_instrumentation::on_release <
+                    typename Storage::value_type>();
+#endif
+                bool must_be_destructed = Count::release_count (
+                    current.object(), static_cast <Storage const &> (current));
+                if (must_be_destructed) {
+                    move_children (current.object(),
+                        [&stack] (Pointer && child) {
+                            if (!child.empty())
+                                stack.push_back (std::move (child));
+                        });
+#ifdef UTILITY_SHARED_INSTRUMENTATION
+                    shared_instrumentation::on_destruct <
+                        typename Storage::value_type>();
+#endif
+                    current.destruct();
+                }
+                // The reference has been released, so "current" must not
+                // release it again when it goes out of scope.
+                current.reset();
+            }
+        }
+    };
+
+    /**
+    Reference count operations for objects derived from utility::shared,
+    utility::local_shared, utility::biased_shared, utility::sharded_shared,
+    utility::weak_shared, or utility::compact_shared.
+    This selects the implementation based on the base class of the object.
+    These forward to the static functions of the base class.
+    Overload resolution happens when the functions are called, so the type of
+    the object does not need to be complete when the pointer type is
+    instantiated.
+
+    release_count is passed the storage policy that holds the reference, which
+    utility::biased_shared may need to keep.
+    */
+    struct shared_count {
+        static void acquire (shared * s) noexcept { shared::acquire (s); }
+        static void acquire (local_shared * s) noexcept
+        { local_shared::acquire (s); }
+        static void acquire (biased_shared * s) noexcept
+        { biased_shared::acquire (s); }
+        static void acquire (sharded_shared * s) noexcept
+        { sharded_shared::acquire (s); }
+        static void acquire (weak_shared * s) noexcept
+        { weak_shared::acquire (s); }
+        template <class Integer, unsigned TagBits>
+            static void acquire (compact_shared <Integer, TagBits> * s)
+            noexcept
+        { compact_shared <Integer, TagBits>::acquire (s); }
+
+        /**
+        Take the first reference to an object whose count is zero.
+        For utility::shared, this avoids an atomic read-modify-write.
+        */
+        static void acquire_first (shared * s) noexcept
+        { shared::acquire_first (s); }
+        static void acquire_first (local_shared * s) noexcept
+        { local_shared::acquire (s); }
+        static void acquire_first (biased_shared * s) noexcept
+        { biased_shared::acquire (s); }
+        static void acquire_first (sharded_shared * s) noexcept
+        { sharded_shared::acquire (s); }
+        static void acquire_first (weak_shared * s) noexcept
+        { weak_shared::acquire_first (s); }
+        template <class Integer, unsigned TagBits>
+            static void acquire_first (compact_shared <Integer, TagBits> * s)
+            noexcept
+        { compact_shared <Integer, TagBits>::acquire (s); }
+
+        template <class Storage>
+            static bool release_count (shared * s, Storage const &) noexcept
+        { return shared::release_count (s); }
+        template <class Storage>
+            static bool release_count (local_shared * s, Storage const &)
+            noexcept
+        { return local_shared::release_count (s); }
+        template <class Storage>
+            static bool release_count (
+                biased_shared * s, Storage const & storage) noexcept
+        { return biased_shared::release_count (s, storage); }
+        template <class Storage>
+            static bool release_count (sharded_shared * s, Storage const &)
+            noexcept
+        { return sharded_shared::release_count (s); }
+        template <class Storage>
+            static bool release_count (weak_shared * s, Storage const &)
+            noexcept
+        { return weak_shared::release_count (s); }
+        template <class Storage, class Integer, unsigned TagBits>
+            static bool release_count (
+                compact_shared <Integer, TagBits> * s, Storage const &)
+            noexcept
+        { return compact_shared <Integer, TagBits>::release_count (s); }
+
+        static long get_count (shared const * s) noexcept
+        { return shared::get_count (s); }
+        static long get_count (local_shared const * s) noexcept
+        { return local_shared::get_count (s); }
+        static long get_count (biased_shared const * s) noexcept
+        { return biased_shared::get_count (s); }
+        static long get_count (sharded_shared const * s) noexcept
+        { return sharded_shared::get_count (s); }
+        static long get_count (weak_shared const * s) noexcept
+        { return weak_shared::get_count (s); }
+        template <class Integer, unsigned TagBits>
+            static long get_count (compact_shared <Integer, TagBits> const * s)
+            noexcept
+        { return compact_shared <Integer, TagBits>::get_count (s); }
+    };
+
+    /**
+    Evaluate to true iff use_count() on a pointer to \a Type is exact whenever
+    this thread is the only owner.
+    This is false for objects derived from utility::biased_shared, whose count
+    is inexact on threads other than the owner thread, and from
+    utility::sharded_shared, whose count is inexact before shutdown() while
+    other threads use the object.
+    */
+    template <class Type> struct has_exact_use_count
+    : std::integral_constant <bool,
+        !std::is_base_of <biased_shared, Type>::value
+        && !std::is_base_of <sharded_shared, Type>::value> {};
+
+    /**
+    Reference counting policy that uses intrusive reference counting.
+    The contained object must be derived from utility::shared,
+    utility::biased_shared, utility::sharded_shared, utility::weak_shared, or
+    utility::compact_shared.
+    The count is atomic, so objects can be shared between threads.
+    */
+    template <class Storage> class reference_count_shared
+    : public intrusive_reference_count <Storage, shared_count>
+    {
+        typedef intrusive_reference_count <Storage, shared_count> base_type;
+    public:
+        template <class ... Arguments>
+        reference_count_shared (Arguments && ... arguments)
+        noexcept (noexcept (base_type (std::declval <Arguments &&>() ...)))
+        : base_type (std::forward <Arguments> (arguments) ...)
+        {
+            typedef typename Storage::value_type value_type;
+            static_assert (std::is_base_of <shared, value_type>::value
+                || std::is_base_of <biased_shared, value_type>::value
+                || std::is_base_of <sharded_shared, value_type>::value
+                || std::is_base_of <weak_shared, value_type>::value
+                || std::is_base_of <compact_shared_base, value_type>::value,
+                "The referenced object must derive from utility::shared, "
+                "utility::biased_shared, utility::sharded_shared, "
+                "utility::weak_shared, or utility::compact_shared.");
+        }
+    };
+
+    /**
+    Reference counting policy that uses intrusive reference counting with a
+    plain, non-atomic, count.
+    The contained object must be derived from utility::local_shared.
+    This is faster than reference_count_shared, but the object, and all
+    pointers to it, must be confined to one thread.
+    */
+    template <class Storage> class reference_count_local
+    : public intrusive_reference_count <Storage, shared_count>
+    {
+        typedef intrusive_reference_count <Storage, shared_count> base_type;
+    public:
+        template <class ... Arguments>
+        reference_count_local (Arguments && ... arguments)
+        noexcept (noexcept (base_type (std::declval <Arguments &&>() ...)))
+        : base_type (std::forward <Arguments> (arguments) ...)
+        {
+            static_assert (std::is_base_of <
+                    local_shared, typename Storage::value_type>::value,
+                "The referenced object must derive from "
+                "utility::local_shared.");
+        }
+    };
+
+    /**
+    Reference count operations for objects that use_allocator_with_count has
+    allocated, with a count_prefix before them.
+    The memory ordering is the same as for utility::shared.
+    */
+    struct prefix_count {
+        template <class Type> static void acquire (Type * object) noexcept {
+            count_prefix_layout <Type>::prefix_of (object)->count.fetch_add (
+                1, std::memory_order_relaxed);
+        }
+
+        template <class Type>
+            static void acquire_first (Type * object) noexcept
+        {
+            count_prefix_layout <Type>::prefix_of (object)->count.store (
+                1, std::memory_order_relaxed);
+        }
+
+        template <class Type, class Storage>
+            static bool release_count (Type * object, Storage const &)
+            noexcept
+        {
+            if (count_prefix_layout <Type>::prefix_of (object)->count
+                    .fetch_sub (1, UTILITY_CONFIG_RELEASE_COUNT_ORDER) == 1)
+            {
+                std::atomic_thread_fence (std::memory_order_acquire);
+                return true;
+            }
+            return false;
+        }
+
+        template <class Type>
+            static long get_count (Type const * object) noexcept
+        {
+            return count_prefix_layout <Type>::prefix_of (object)->count.load (
+                std::memory_order_relaxed);
+        }
+    };
+
+    /**
+    Reference counting policy that uses the count_prefix that
+    use_allocator_with_count puts before the object.
+    The object can be of any type.
+    The count is atomic, so objects can be shared between threads.
+    */
+    template <class Storage> class reference_count_prefix
+    : public intrusive_reference_count <Storage, prefix_count>
+    {
+        typedef intrusive_reference_count <Storage, prefix_count> base_type;
+    public:
+        template <class ... Arguments>
+        reference_count_prefix (Arguments && ... arguments)
+        noexcept (noexcept (base_type (std::declval <Arguments &&>() ...)))
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+    };
+
+    /**
+    Reference counting policy like reference_count_shared, but which defers
+    releases.
+    The contained object must be derived from utility::shared.
+    Releases are recorded in a buffer local to the thread, and applied when
+    flush_deferred_releases() is called, when the buffer needs space, or when
+    the thread exits.
+    An acquire in the same thread cancels a pending release.
+    This is useful when a thread repeatedly acquires and releases references to
+    the same objects.
+    Objects are destructed only when the releases are applied, so their
+    lifetime can be extended until then.
+    */
+    template <class Storage> class reference_count_deferred
+    : public intrusive_reference_count <
+        Storage, deferred_shared_count <Storage>>
+    {
+        typedef intrusive_reference_count <
+            Storage, deferred_shared_count <Storage>> base_type;
+    public:
+        template <class ... Arguments>
+        reference_count_deferred (Arguments && ... arguments)
+        noexcept (noexcept (base_type (std::declval <Arguments &&>() ...)))
+        : base_type (std::forward <Arguments> (arguments) ...)
+        {
+            static_assert (std::is_base_of <
+                    shared, typename Storage::value_type>::value,
+                "The referenced object must derive from utility::shared.");
+        }
+    };
+
+    /**
+    Lifetime policy for objects that are reclaimed with epoch-based
+    reclamation, instead of reference counting.
+    Copying and destructing a pointer do not touch the object, so that readers
+    can traverse a data structure without writing to shared memory.
+    Readers must hold an epoch::guard while they use objects that other
+    threads may retire.
+
+    Pointers do not own the object.
+    Instead, a writer unlinks the object from the data structure and then
+    calls retire() on one pointer to it.
+    The object is destructed through the storage policy once all threads have
+    passed the current epoch.
+    Every object must be retired exactly once, or it is leaked.
+    */
+    template <class Storage> class epoch_reclamation
+    : public Storage
+    {
+    public:
+        template <class ... Arguments>
+        epoch_reclamation (Arguments && ... arguments)
+        noexcept (noexcept (Storage (std::forward <Arguments> (arguments) ...)))
+        : Storage (std::forward <Arguments> (arguments) ...) {}
+
+        // Use default copy, move, copy assignment, and move assignment.
+        // Use default destructor.
+
+        /**
+        Retire the object, so that it will be destructed once no thread can be
+        reading it, and make this pointer empty.
+        Other pointers to the object remain valid for readers that have
+        pinned the epoch.
+        */
+        void retire() {
+            if (!Storage::empty()) {
+                epoch::retire (static_cast <Storage const &> (*this));
+                Storage::reset();
+            }
+        }
+    };
+
+    /**
+    Lifetime policy for unique ownership, like std::unique_ptr.
+    The pointer is move-only, and the object is destructed when the pointer
+    that owns it is destructed or assigned to.
+    There is no reference count, so the object does not need to derive from
+    any class.
+
+    Combined with with_recursive_type, a chain of objects is destructed
+    iteratively.
+    */
+    template <class Storage> class unique_owner
+    : public Storage
+    {
+    public:
+        template <class ... Arguments>
+        unique_owner (Arguments && ... arguments)
+        noexcept (noexcept (Storage (std::forward <Arguments> (arguments) ...)))
+        : Storage (std::forward <Arguments> (arguments) ...) {}
+
+        unique_owner (unique_owner const &) = delete;
+
+        /**
+        Move-construct from another pointer.
+        Afterwards, the original pointer will be empty.
+        */
+        unique_owner (unique_owner && that)
+        noexcept (noexcept (Storage (std::declval <Storage &&>())))
+        : Storage (std::move (that))
+        {
+            static_assert (noexcept (that.Storage::reset()), "By definition");
+            that.Storage::reset();
+        }
+
+        unique_owner & operator= (unique_owner const &) = delete;
+
+        unique_owner & operator= (unique_owner && that) {
+            // Move "that" out first, in case destructing the object in "this"
+            // destructs "that".
+            // This can happen in a linked list.
+            Storage save = std::move (that);
+            that.Storage::reset();
+            destruct_object();
+            Storage::operator= (std::move (save));
+            return *this;
+        }
+
+        ~unique_owner() noexcept { destruct_object(); }
+
+        /**
+        \return 1 if this owns an object, and 0 if it is empty.
+        This is for generic code that works with reference-counted pointers.
+        */
+        long use_count() const { return Storage::empty() ? 0 : 1; }
+
+        /**
+        \return true iff this owns an object.
+        */
+        bool unique() const { return !Storage::empty(); }
+
+        /**
+        Give up ownership of the object without destructing it, and make this
+        empty.
+        \return The object, or nullptr if this was empty.
+        */
+        typename Storage::value_type * release() noexcept {
+            typename Storage::value_type * object = Storage::object();
+            Storage::reset();
+            return object;
+        }
+
+    private:
+        void destruct_object() noexcept {
+            if (!Storage::empty()) {
+                Storage::destruct();
+                Storage::reset();
+            }
+        }
+
+        template <class Storage2> friend class with_recursive_type;
+        template <class Storage2> friend class with_recursive_children;
+
+        /**
+        Destruct a chain of objects iteratively, until \a budget objects have
+        been destructed.
+        \a budget is decreased by the number of objects destructed.
+        Move the pointer to the next object out before destructing the current
+        object.
+
+        \return The rest of the chain, or an empty pointer.
+        */
+        template <class Pointer, class Enable = typename boost::enable_if <
+            std::is_base_of <unique_owner, Pointer>>::type>
+        static Pointer release_chain (Pointer && p, std::size_t & budget)
+            noexcept
+        {
+            Pointer current = std::move (p);
+            move_recursive_next <typename Storage::value_type> move_next;
+
+            for (; !current.empty() && budget != 0; -- budget) {
+                auto next = move_next (current.object());
+                current.destruct();
+                // Reset the pointer, because otherwise the object would be
+                // destructed again here.
+                current.reset();
+                current = std::move (next);
+            }
+            return current;
+        }
+
+        /**
+        Destruct a tree of objects iteratively, with a stack on the heap.
+        The children of each object are moved out with
+        move_recursive_children before the object is destructed.
+
+        \pre !p.empty()
+        */
+        template <class Pointer, class Enable = typename boost::enable_if <
+            std::is_base_of <unique_owner, Pointer>>::type>
+        static void release_tree (Pointer && p) noexcept
+        {
+            move_recursive_children <typename Storage::value_type>
+                move_children;
+            // If this allocation fails, the program is terminated.
+            std::vector <Pointer> stack;
+            stack.push_back (std::move (p));
+
+            while (!stack.empty()) {
+                Pointer current = std::move (stack.back());
+                stack.pop_back();
+                move_children (current.object(),
+                    [&stack] (Pointer && child) {
+                        if (!child.empty())
+                            stack.push_back (std::move (child));
+                    });
+                current.destruct();
+                // Reset the pointer, because otherwise the object would be
+                // destructed again here.
+                current.reset();
+            }
+        }
+    };
+
+    /* Storage and lifetime policies. */
+
+    /**
+    Policy that keeps the object inside the pointer, which makes it more of a
+    "box".
+    There is no heap allocation and no indirection.
+    The box has value semantics: copying it copies the object, and moving it
+    moves the object and makes the source empty.
+    Assignment destructs the object and then constructs a new one; if that
+    throws, this is left empty.
+    Swapping requires the object to be nothrow move constructible and
+    assignable.
+
+    Since each box has its own object, two boxes compare equal under
+    strict_weak_ordered only if they are both empty.
+    This is useful for small objects, and for generic code that can switch
+    between, say, small_ptr and a box with a typedef.
+    */
+    template <class Type> class inline_box {
+    public:
+        typedef Type value_type;
+
+    public:
+        inline_box() noexcept : constructed_ (false) {}
+
+        template <class ... Arguments>
+        inline_box (construct_as <Type>, Arguments && ... arguments)
+        noexcept (noexcept (Type (std::declval <Arguments &&>() ...)))
+        : constructed_ (false)
+        {
+            new (memory_.memory()) Type (
+                std::forward <Arguments> (arguments) ...);
+            constructed_ = true;
+        }
+
+        inline_box (inline_box const & that)
+        noexcept (noexcept (Type (std::declval <Type const &>())))
+        : constructed_ (false)
+        {
+            if (that.constructed_) {
+                new (memory_.memory()) Type (*that.memory_.object());
+                constructed_ = true;
+            }
+        }
+
+        inline_box (inline_box && that)
+        noexcept (noexcept (Type (std::declval <Type &&>())))
+        : constructed_ (false)
+        {
+            if (that.constructed_) {
+                new (memory_.memory()) Type (
+                    std::move (*that.memory_.object()));
+                constructed_ = true;
+                that.destruct_object();
+            }
+        }
+
+        ~inline_box() noexcept { destruct_object(); }
+
+        inline_box & operator= (inline_box const & that) {
+            if (this != &that) {
+                destruct_object();
+                if (that.constructed_) {
+                    new (memory_.memory()) Type (*that.memory_.object());
+                    constructed_ = true;
+                }
+            }
+            return *this;
+        }
+
+        inline_box & operator= (inline_box && that) {
+            if (this != &that) {
+                destruct_object();
+                if (that.constructed_) {
+                    new (memory_.memory()) Type (
+                        std::move (*that.memory_.object()));
+                    constructed_ = true;
+                    that.destruct_object();
+                }
+            }
+            return *this;
+        }
+
+    protected:
+        Type * object() const {
+            return constructed_
+                ? const_cast <Type *> (memory_.object()) : nullptr;
+        }
+
+        /**
+        Swap the objects with three moves.
+        pointer::swap is noexcept, so the moves must not throw.
+        */
+        void swap (inline_box & that) noexcept {
+            static_assert (std::is_nothrow_move_constructible <Type>::value
+                && std::is_nothrow_move_assignable <Type>::value,
+                "Swapping boxes requires a type that moves without throwing.");
+            inline_box temporary (std::move (that));
+            that = std::move (*this);
+            *this = std::move (temporary);
+        }
+
+    public:
+        /**
+        \return true iff this contains an object.
+        */
+        bool empty() const { return !constructed_; }
+
+    private:
+        assignable_detail::memory_for <Type> memory_;
+        bool constructed_;
+
+        void destruct_object() noexcept {
+            if (constructed_) {
+                memory_.object()->~Type();
+                constructed_ = false;
+            }
         }
     };
 
@@ -507,6 +1978,60 @@ namespace utility { namespace pointer_policy {
         value_type * get() const { return Lifetime::object(); }
     };
 
+    /**
+    Access policy that implements copy-on-write.
+    Const access shares the object with other owners.
+    write() returns a mutable reference, after copying the object through the
+    storage policy's clone() if it has other owners.
+    If this is the only owner, no copy is made.
+
+    Another thread must not make a new owner of the object while write() is
+    called, for example from a weak pointer.
+    Since the decision to copy relies on use_count(), the count must be exact;
+    see has_exact_use_count.
+    */
+    template <class Lifetime> class copy_on_write_access
+    : public Lifetime {
+    public:
+        template <class ... Arguments>
+        copy_on_write_access (Arguments && ... arguments)
+            noexcept (noexcept (Lifetime (std::declval <Arguments &&>() ...)))
+        : Lifetime (std::forward <Arguments> (arguments) ...) {}
+
+        typedef typename Lifetime::value_type value_type;
+
+        value_type const & operator* () const { return *Lifetime::object(); }
+
+        value_type const * operator-> () const { return Lifetime::object(); }
+
+        /**
+        \return A const pointer to the owned object, or nullptr if this is
+        empty.
+        */
+        value_type const * get() const { return Lifetime::object(); }
+
+        /**
+        \return A mutable reference to the object, which this is then the
+        only owner of.
+        \pre This is not empty.
+        */
+        value_type & write() {
+            static_assert (has_exact_use_count <value_type>::value,
+                "Copy-on-write needs an exact use count, which "
+                "utility::biased_shared and utility::sharded_shared do not "
+                "provide.");
+            assert (!Lifetime::empty());
+            if (Lifetime::use_count() != 1)
+                Lifetime::operator= (Lifetime (Lifetime::clone()));
+            else {
+                // Make sure that reads through other owners that have been
+                // released happen before the object is changed.
+                std::atomic_thread_fence (std::memory_order_acquire);
+            }
+            return *Lifetime::object();
+        }
+    };
+
     /* Ordering policies. */
 
     /**
@@ -0,0 +1,313 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Allocator for many objects of the same small size, like the nodes of a list or
+a tree.
+
+Memory is taken from the system in large slabs, which are cut up into blocks
+of one size.
+Blocks that are deallocated are kept in a free list and handed out again.
+This is much faster than allocating each object separately.
+*/
+
+#ifndef UTILITY_POOL_ALLOCATOR_HPP_INCLUDED
+#define UTILITY_POOL_ALLOCATOR_HPP_INCLUDED
+
+#include <cstddef>
+#include <new>
+#include <cassert>
+#include <mutex>
+
+namespace utility {
+
+    /**
+    Pool of blocks of one size.
+    This is not thread-safe.
+
+    The memory is allocated in slabs of a fixed size, with ::operator new.
+    It is only released when the pool is destructed.
+    */
+    class fixed_size_pool {
+    public:
+        /// The alignment of all blocks.
+        static constexpr std::size_t alignment = alignof (std::max_align_t);
+
+        /// The default size of a slab, in bytes.
+        static constexpr std::size_t default_slab_size = 64 * 1024;
+
+    private:
+        struct free_block { free_block * next; };
+
+        /// Header at the start of each slab.
+        struct slab { slab * next; };
+
+        static constexpr std::size_t slab_header_size
+            = (sizeof (slab) + alignment - 1) / alignment * alignment;
+
+        static std::size_t round_up (std::size_t size) noexcept
+        { return (size + alignment - 1) / alignment * alignment; }
+
+        std::size_t block_size_;
+        std::size_t blocks_per_slab_;
+        free_block * free_;
+        slab * slabs_;
+
+        /**
+        Allocate a new slab and put its blocks on the free list.
+        */
+        void grow() {
+            char * memory = static_cast <char *> (::operator new (
+                slab_header_size + blocks_per_slab_ * block_size_));
+            slab * new_slab = reinterpret_cast <slab *> (memory);
+            new_slab->next = slabs_;
+            slabs_ = new_slab;
+
+            // Put the blocks on the free list so that the first block comes
+            // first.
+            char * blocks = memory + slab_header_size;
+            for (std::size_t i = blocks_per_slab_; i != 0; -- i) {
+                free_block * block
+                    = reinterpret_cast <free_block *> (
+                        blocks + (i - 1) * block_size_);
+                block->next = free_;
+                free_ = block;
+            }
+        }
+
+    public:
+        /**
+        \param block_size
+            The size of the blocks.
+            This is rounded up to a multiple of \a alignment.
+        \param slab_size
+            The size in bytes of each slab that is allocated.
+            Each slab contains at least one block.
+        */
+        explicit fixed_size_pool (std::size_t block_size,
+            std::size_t slab_size = default_slab_size) noexcept
+        : block_size_ (round_up (block_size < sizeof (free_block)
+            ? sizeof (free_block) : block_size)),
+            blocks_per_slab_ (slab_size > slab_header_size + block_size_
+                ? (slab_size - slab_header_size) / block_size_ : 1),
+            free_ (nullptr), slabs_ (nullptr) {}
+
+        fixed_size_pool (fixed_size_pool const &) = delete;
+        fixed_size_pool & operator = (fixed_size_pool const &) = delete;
+
+        /**
+        Release all memory.
+        Any blocks that are still in use become invalid.
+        */
+        ~fixed_size_pool() noexcept {
+            while (slabs_) {
+                slab * next = slabs_->next;
+                ::operator delete (slabs_);
+                slabs_ = next;
+            }
+        }
+
+        std::size_t block_size() const noexcept { return block_size_; }
+
+        /**
+        \return true iff the next call to allocate() will allocate a new slab.
+        */
+        bool exhausted() const noexcept { return !free_; }
+
+        /**
+        Take over the slabs and the free blocks of \a that, which must have
+        the same block size.
+        Afterwards, \a that is empty.
+        Blocks from \a that that are in use can be deallocated to this.
+        */
+        void splice (fixed_size_pool & that) noexcept {
+            assert (that.block_size_ == block_size_);
+            if (that.free_) {
+                free_block * last_free = that.free_;
+                while (last_free->next)
+                    last_free = last_free->next;
+                last_free->next = free_;
+                free_ = that.free_;
+                that.free_ = nullptr;
+            }
+            if (that.slabs_) {
+                slab * last_slab = that.slabs_;
+                while (last_slab->next)
+                    last_slab = last_slab->next;
+                last_slab->next = slabs_;
+                slabs_ = that.slabs_;
+                that.slabs_ = nullptr;
+            }
+        }
+
+        /**
+        \return A block of memory of block_size() bytes.
+        \throw std::bad_alloc If no new slab can be allocated.
+        */
+        void * allocate() {
+            if (!free_)
+                grow();
+            free_block * block = free_;
+            free_ = block->next;
+            return block;
+        }
+
+        /**
+        Return a block that allocate() has returned to the pool.
+        */
+        void deallocate (void * memory) noexcept {
+            free_block * block = static_cast <free_block *> (memory);
+            block->next = free_;
+            free_ = block;
+        }
+    };
+
+    namespace pool_allocator_detail {
+
+        /// Objects larger than this are not allocated from a pool.
+        static constexpr std::size_t max_pooled_size = 256;
+
+        /**
+        Global pool that holds the blocks of threads that have exited.
+        It is never destructed, so that objects can be deallocated during
+        static destruction.
+        */
+        class orphan_pool {
+        public:
+            std::mutex mutex;
+            fixed_size_pool pool;
+
+            explicit orphan_pool (std::size_t block_size) noexcept
+            : pool (block_size) {}
+        };
+
+        /**
+        Pool for one block size, local to one thread.
+        When it runs out, it takes the blocks of threads that have exited
+        before it allocates a new slab.
+        When the thread exits, its blocks, including the ones that other
+        threads are still using, are handed to the global pool.
+        */
+        template <std::size_t BlockSize> class thread_pool {
+            fixed_size_pool pool;
+
+            static orphan_pool & orphans() {
+                static orphan_pool & instance = *new orphan_pool (BlockSize);
+                return instance;
+            }
+
+        public:
+            thread_pool() noexcept : pool (BlockSize) {}
+
+            ~thread_pool() noexcept {
+                orphan_pool & global = orphans();
+                std::lock_guard <std::mutex> lock (global.mutex);
+                global.pool.splice (pool);
+            }
+
+            static thread_pool & current() {
+                static thread_local thread_pool instance;
+                return instance;
+            }
+
+            void * allocate() {
+                if (pool.exhausted()) {
+                    orphan_pool & global = orphans();
+                    std::lock_guard <std::mutex> lock (global.mutex);
+                    pool.splice (global.pool);
+                }
+                return pool.allocate();
+            }
+
+            void deallocate (void * memory) noexcept
+            { pool.deallocate (memory); }
+        };
+
+        template <class Type> struct pool_for {
+            static constexpr bool pooled = sizeof (Type) <= max_pooled_size
+                && alignof (Type) <= fixed_size_pool::alignment;
+
+            static constexpr std::size_t block_size
+                = (sizeof (Type) + fixed_size_pool::alignment - 1)
+                / fixed_size_pool::alignment * fixed_size_pool::alignment;
+
+            typedef thread_pool <block_size> type;
+        };
+
+    } // namespace pool_allocator_detail
+
+    /**
+    Allocator that allocates single objects from pools, one for each block
+    size.
+    This is useful for small_ptr, which allocates objects one at a time.
+    The allocator is stateless, so that it does not make small_ptr larger, and
+    all instances compare equal.
+
+    Each thread has its own pools, so that no locking is necessary.
+    An object can be deallocated by any thread, but its memory then goes to the
+    pool of the thread that deallocates it.
+    If one thread keeps allocating objects and another thread keeps
+    deallocating them, memory will accumulate in the latter's pool.
+    When a thread exits, its memory is handed to other threads.
+    Memory is never returned to the system.
+    Objects must not be deallocated after the current thread's thread-local
+    objects have been destructed, for example in destructors of static
+    objects.
+
+    Arrays, objects larger than 256 bytes, and over-aligned objects are
+    allocated with ::operator new.
+    */
+    template <class Type> class pool_allocator {
+    public:
+        typedef Type value_type;
+
+        pool_allocator() noexcept {}
+
+        template <class Other>
+            pool_allocator (pool_allocator <Other> const &) noexcept {}
+
+        Type * allocate (std::size_t n) {
+            typedef pool_allocator_detail::pool_for <Type> pool_for;
+            if (pool_for::pooled && n == 1)
+                return static_cast <Type *> (
+                    pool_for::type::current().allocate());
+            return static_cast <Type *> (::operator new (n * sizeof (Type)));
+        }
+
+        void deallocate (Type * object, std::size_t n) noexcept {
+            typedef pool_allocator_detail::pool_for <Type> pool_for;
+            if (pool_for::pooled && n == 1)
+                pool_for::type::current().deallocate (object);
+            else
+                ::operator delete (object);
+        }
+    };
+
+    template <class Type1, class Type2>
+        inline bool operator == (
+            pool_allocator <Type1> const &, pool_allocator <Type2> const &)
+        noexcept
+    { return true; }
+
+    template <class Type1, class Type2>
+        inline bool operator != (
+            pool_allocator <Type1> const &, pool_allocator <Type2> const &)
+        noexcept
+    { return false; }
+
+} // namespace utility
+
+#endif // UTILITY_POOL_ALLOCATOR_HPP_INCLUDED
@@ -0,0 +1,182 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Background thread that releases pointers, so that destructing a large data
+structure does not hold up the thread that drops the last reference to it.
+
+Pointers are posted to the reclaimer, which takes over their reference and
+releases it on its own thread.
+The thread is started when the first pointer is posted, and it is stopped,
+after it has released all pointers, during static destruction.
+Pointers must therefore not be posted after static destruction has started.
+
+pointer_policy::destruct_chain_in_background uses this to destruct the long
+tail of a chain of objects.
+*/
+
+#ifndef UTILITY_RECLAIMER_HPP_INCLUDED
+#define UTILITY_RECLAIMER_HPP_INCLUDED
+
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace utility { namespace reclaimer {
+
+    namespace detail {
+
+        /**
+        Pointer that has been posted to the reclaimer.
+        Deleting the job releases the pointer.
+        */
+        class job {
+        public:
+            job() noexcept : next (nullptr) {}
+            virtual ~job() noexcept {}
+
+            job * next;
+        };
+
+        template <class Pointer> class pointer_job : public job {
+            Pointer pointer;
+        public:
+            explicit pointer_job (Pointer && pointer) noexcept
+            : pointer (std::move (pointer)) {}
+        };
+
+        /// \return true iff the current thread is the reclaimer thread.
+        inline bool & on_reclaimer_thread() noexcept {
+            static thread_local bool value = false;
+            return value;
+        }
+
+        /**
+        The reclaimer thread and its queue of jobs, which are run in the order
+        in which they were posted.
+        */
+        class reclaimer_thread {
+            std::mutex mutex;
+            std::condition_variable work_available;
+            std::condition_variable idle;
+            job * first;
+            job * last;
+            bool busy;
+            bool stopping;
+            std::thread thread;
+
+            void run() {
+                on_reclaimer_thread() = true;
+                std::unique_lock <std::mutex> lock (mutex);
+                while (true) {
+                    work_available.wait (lock,
+                        [this] { return first || stopping; });
+                    if (!first)
+                        return;
+                    job * current = first;
+                    first = nullptr;
+                    last = nullptr;
+                    busy = true;
+                    lock.unlock();
+                    while (current) {
+                        job * next = current->next;
+                        delete current;
+                        current = next;
+                    }
+                    lock.lock();
+                    busy = false;
+                    if (!first)
+                        idle.notify_all();
+                }
+            }
+
+        public:
+            reclaimer_thread()
+            : first (nullptr), last (nullptr), busy (false), stopping (false),
+                thread ([this] { run(); }) {}
+
+            /**
+            Stop the thread once it has run all jobs.
+            */
+            ~reclaimer_thread() noexcept {
+                {
+                    std::lock_guard <std::mutex> lock (mutex);
+                    stopping = true;
+                }
+                work_available.notify_one();
+                thread.join();
+            }
+
+            static reclaimer_thread & get() {
+                static reclaimer_thread instance;
+                return instance;
+            }
+
+            void post (job * j) noexcept {
+                {
+                    std::lock_guard <std::mutex> lock (mutex);
+                    if (last)
+                        last->next = j;
+                    else
+                        first = j;
+                    last = j;
+                }
+                work_available.notify_one();
+            }
+
+            void drain() {
+                std::unique_lock <std::mutex> lock (mutex);
+                idle.wait (lock, [this] { return !first && !busy; });
+            }
+        };
+
+    } // namespace detail
+
+    /**
+    Hand \a pointer over to the reclaimer thread, which will release it.
+    Afterwards, \a pointer is empty.
+    */
+    template <class Pointer> inline void post (Pointer && pointer) {
+        typedef typename std::decay <Pointer>::type pointer_type;
+        // If this allocation fails, the program is terminated.
+        detail::reclaimer_thread::get().post (
+            new detail::pointer_job <pointer_type> (std::move (pointer)));
+    }
+
+    /**
+    Wait until the reclaimer thread has released all pointers that have been
+    posted, including pointers that were posted while it was releasing
+    others.
+    This must not be called from the reclaimer thread.
+    */
+    inline void drain() {
+        assert (!detail::on_reclaimer_thread());
+        detail::reclaimer_thread::get().drain();
+    }
+
+    /**
+    \return true iff this is called from the reclaimer thread, for example
+    from the destructor of an object that it is releasing.
+    */
+    inline bool on_reclaimer_thread() noexcept
+    { return detail::on_reclaimer_thread(); }
+
+}} // namespace utility::reclaimer
+
+#endif // UTILITY_RECLAIMER_HPP_INCLUDED
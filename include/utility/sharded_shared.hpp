@@ -0,0 +1,215 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef UTILITY_SHARDED_SHARED_HPP_INCLUDED
+#define UTILITY_SHARDED_SHARED_HPP_INCLUDED
+
+#include <cstddef>
+#include <climits>
+#include <atomic>
+
+#include "config.hpp"
+
+namespace utility {
+
+    namespace sharded_shared_detail {
+
+        /**
+        \return The index of the slot that the current thread uses.
+        Threads are assigned to slots round-robin, the first time they need
+        one.
+        */
+        inline std::size_t current_slot (std::size_t slot_count) noexcept {
+            // 0 means "not assigned yet", so this needs no dynamic
+            // initialisation.
+            static thread_local std::size_t slot_plus_one = 0;
+            if (slot_plus_one == 0) {
+                static std::atomic <std::size_t> next_slot (0);
+                slot_plus_one = next_slot.fetch_add (
+                    1, std::memory_order_relaxed) % slot_count + 1;
+            }
+            return slot_plus_one - 1;
+        }
+
+    } // namespace sharded_shared_detail
+
+    /**
+    Base class for reference-counted objects that are acquired and released
+    very often by many threads at the same time.
+    This can be used with small_ptr instead of utility::shared.
+
+    The count for utility::shared is kept in one cache line, which then moves
+    between processor cores all the time.
+    This class instead spreads the count over a number of slots, each in its
+    own cache line.
+    Each thread uses one slot.
+    The sum of all the slots is the count.
+
+    In this "sharded" mode, the count is never checked for reaching zero, and
+    the object is never destructed.
+    An owner must call shutdown() to switch to "collapsed" mode: then the slots
+    are summed into one count, and from then on the object works like
+    utility::shared, and is destructed when the last reference is released.
+    Until the end of shutdown(), the collapsed count holds a large bias.
+    While shutdown() adds the slots to it one by one, references can be
+    released through slots that have already been collapsed, before the
+    references that they balance, in other slots, have been added.
+    The bias makes sure that the collapsed count cannot drop to zero then.
+
+    This is similar to percpu_ref in the Linux kernel.
+    The memory use is large: slot_count cache lines per object.
+    Since the slots are aligned to cache lines, so are objects of this class;
+    small_ptr::construct allocates them with the right alignment.
+    */
+    class sharded_shared {
+    public:
+        /// The number of slots that the count is spread over.
+        static constexpr std::size_t slot_count = 16;
+
+    private:
+        static constexpr std::size_t cache_line_size = 64;
+
+        /**
+        Value of a slot after it has been collapsed.
+        A thread that finds this uses the collapsed count instead.
+        */
+        static constexpr long collapsed = LONG_MIN;
+
+        /**
+        Value that the collapsed count starts at, and that shutdown()
+        subtracts after all slots have been collapsed.
+        The actual count is assumed to stay far below this.
+        */
+        static constexpr long bias = LONG_MAX / 2;
+
+        /// Slot, in its own cache line.
+        struct alignas (cache_line_size) slot {
+            std::atomic <long> count;
+
+            slot() noexcept : count (0l) {}
+        };
+
+        slot slots [slot_count];
+        std::atomic <long> collapsed_count;
+        std::atomic <bool> shut_down;
+
+        /**
+        Add \a difference to the slot for the current thread.
+        \return false iff the slot has been collapsed, and the collapsed count
+        must be used.
+        */
+        bool change_slot (long difference) noexcept {
+            std::atomic <long> & count = slots [
+                sharded_shared_detail::current_slot (slot_count)].count;
+            long value = count.load (std::memory_order_relaxed);
+            do {
+                if (value == collapsed)
+                    return false;
+            // "release" so that shutdown() synchronises with this.
+            } while (!count.compare_exchange_weak (value, value + difference,
+                std::memory_order_release, std::memory_order_relaxed));
+            return true;
+        }
+
+    protected:
+        sharded_shared() noexcept : collapsed_count (bias), shut_down (false)
+        {}
+
+        // The copy and move constructors mustn't copy the count.
+        sharded_shared (sharded_shared const &) noexcept
+        : collapsed_count (bias), shut_down (false) {}
+        sharded_shared (sharded_shared &&) noexcept
+        : collapsed_count (bias), shut_down (false) {}
+
+        // Assignment mustn't copy the count.
+        sharded_shared & operator = (sharded_shared const &) noexcept
+        { return *this; }
+        sharded_shared & operator = (sharded_shared &&) noexcept
+        { return *this; }
+
+    public:
+        /**
+        Register as an owner of the object.
+        Call release_count later to deregister.
+        */
+        static void acquire (sharded_shared * s) noexcept {
+            if (!s->change_slot (+1))
+                s->collapsed_count.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        /**
+        Release a reference to a sharded_shared object.
+        \return true iff this was the last reference, i.e. iff the object must
+        be deleted.
+        This can only be true after shutdown() has been called.
+        */
+        static bool release_count (sharded_shared * s) noexcept {
+            if (s->change_slot (-1))
+                return false;
+            if (s->collapsed_count.fetch_sub (
+                    1, UTILITY_CONFIG_RELEASE_COUNT_ORDER)
+                    == 1)
+            {
+                std::atomic_thread_fence (std::memory_order_acquire);
+                return true;
+            }
+            return false;
+        }
+
+        /**
+        \return The current number of owners of this object.
+        Before shutdown() is called, this sums the slots, so it is exact only if
+        no other thread is acquiring or releasing references at the same time.
+        */
+        static long get_count (sharded_shared const * s) noexcept {
+            long count = s->collapsed_count.load (std::memory_order_relaxed);
+            // Do not count the bias, if it is still there.
+            if (count > bias / 2)
+                count -= bias;
+            for (slot const & slot : s->slots) {
+                long value = slot.count.load (std::memory_order_relaxed);
+                if (value != collapsed)
+                    count += value;
+            }
+            return count;
+        }
+
+        /**
+        Collapse the slots into one count, so that the object is destructed
+        when the last reference is released.
+        This is expensive, and should be called once, by a thread that holds a
+        reference to the object.
+        Calling it again has no effect.
+        */
+        static void shutdown (sharded_shared * s) noexcept {
+            if (s->shut_down.exchange (true, std::memory_order_relaxed))
+                return;
+            for (slot & slot : s->slots) {
+                long value = slot.count.exchange (
+                    collapsed, std::memory_order_acq_rel);
+                s->collapsed_count.fetch_add (
+                    value, std::memory_order_acq_rel);
+            }
+            // Remove the bias only now that all slots have been added.
+            // This cannot release the last reference, since the caller holds
+            // one.
+            s->collapsed_count.fetch_sub (bias, std::memory_order_release);
+        }
+    };
+
+} // namespace utility
+
+#endif // UTILITY_SHARDED_SHARED_HPP_INCLUDED
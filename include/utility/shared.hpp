@@ -18,28 +18,74 @@ limitations under the License.
 #define UTILITY_SHARED_HPP_INCLUDED
 
 #include <new>
+#include <cstddef>
+#include <climits>
 #include <type_traits>
+#include <atomic>
+#include <cassert>
 
-#include <boost/detail/atomic_count.hpp>
 #include <boost/utility/enable_if.hpp>
 
+#include "config.hpp"
 #include "with_allocator.hpp"
 
 namespace utility {
 
     class shared;
+    class local_shared;
 
     /**
     Base class for reference-counted objects.
+
+    The count is atomic, but the memory ordering is as weak as possible.
+    Acquiring a reference does not need to synchronise with anything, since the
+    new owner already has access to the object through another owner.
+    Releasing a reference needs "release" semantics so that all accesses to the
+    object happen before its destruction.
+    Only the thread that drops the last reference needs an "acquire" fence, so
+    that it sees the effect of all accesses from other threads before it
+    destructs the object.
+    Under Thread Sanitizer, which does not model fences, releasing uses
+    "acquire-release" semantics instead; see config.hpp.
+
+    An object can be constructed as "immortal", by passing immortal_tag to the
+    constructor.
+    Its count is then never changed, so acquiring and releasing references to
+    it does not need any atomic read-modify-write operations, and it is never
+    destructed through a pointer.
+    This is useful for global constants, like sentinel nodes.
+    The constructor is constexpr, so that such objects can be defined at
+    namespace scope without dynamic initialisation, if the derived class's
+    constructor is constexpr too.
+    \code
+    struct node : utility::shared {
+        int value;
+        constexpr node (utility::shared::immortal_tag tag)
+        : utility::shared (tag), value (0) {}
+    };
+    node sentinel {utility::shared::immortal_tag()};
+    \endcode
     \sa small_ptr
     */
     class shared {
     private:
-        boost::detail::atomic_count count;
+        std::atomic <long> count;
+
+        /// Value of the count for an immortal object.
+        static constexpr long immortal_count = LONG_MAX;
+
+    public:
+        /// Tag to construct an immortal object.
+        struct immortal_tag {};
 
     protected:
         shared() noexcept : count (0l) {}
 
+        /**
+        Construct an immortal object.
+        */
+        constexpr shared (immortal_tag) noexcept : count (immortal_count) {}
+
         // The copy and move constructors mustn't copy the count.
         shared (shared const &) noexcept : count (0l) {}
         shared (shared &&) noexcept : count (0l) {}
@@ -51,22 +97,95 @@ namespace utility {
     public:
         /**
         Register as an owner of the object.
-        Call release_count later to der
+        Call release_count later to deregister.
         */
-        static void acquire (shared * s) noexcept { ++ s->count; }
+        static void acquire (shared * s) noexcept {
+            if (!is_immortal (s))
+                s->count.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        /**
+        Register the first owner of an object that has never been owned
+        through its count, for example because it was owned by a
+        unique_small_ptr.
+        No other thread can hold a reference to it yet, so this is a plain
+        store instead of an atomic read-modify-write.
+        */
+        static void acquire_first (shared * s) noexcept {
+            assert (get_count (s) == 0);
+            s->count.store (1, std::memory_order_relaxed);
+        }
+
+        /**
+        Register as an owner of the object, but only if it has an owner
+        already.
+        This is lock-free, and is used to turn a weak reference into an owner.
+        \return true iff this is now an owner; false iff the count was zero.
+        */
+        static bool try_acquire (shared * s) noexcept {
+            long count = s->count.load (std::memory_order_relaxed);
+            do {
+                if (count == 0)
+                    return false;
+                if (count == immortal_count)
+                    return true;
+            } while (!s->count.compare_exchange_weak (
+                count, count + 1, std::memory_order_relaxed));
+            return true;
+        }
 
         /**
         Release a reference to a shared object.
         \return true iff this was the last reference, i.e. iff the object must
         be deleted.
         */
-        static bool release_count (shared * s) noexcept
-        { return ! -- s->count; }
+        static bool release_count (shared * s) noexcept {
+            if (is_immortal (s))
+                return false;
+            if (s->count.fetch_sub (1, UTILITY_CONFIG_RELEASE_COUNT_ORDER)
+                    == 1)
+            {
+                std::atomic_thread_fence (std::memory_order_acquire);
+                return true;
+            }
+            return false;
+        }
+
+        /**
+        Release \a number references to a shared object at once.
+        \return true iff these were the last references, i.e. iff the object
+        must be deleted.
+        */
+        static bool release_count (shared * s, long number) noexcept {
+            if (is_immortal (s))
+                return false;
+            if (s->count.fetch_sub (
+                    number, UTILITY_CONFIG_RELEASE_COUNT_ORDER)
+                    == number)
+            {
+                std::atomic_thread_fence (std::memory_order_acquire);
+                return true;
+            }
+            return false;
+        }
 
         /**
         \return The current number of owners of this object.
+        For an immortal object, this is LONG_MAX.
+        */
+        static long get_count (shared const * s) noexcept
+        { return s->count.load (std::memory_order_relaxed); }
+
+        /**
+        \return true iff the object was constructed as immortal.
+        The count of a mortal object can never reach the value for immortal
+        objects, and the count of an immortal object never changes, so this
+        is a plain load.
         */
-        static long get_count (shared const * s) noexcept { return s->count; }
+        static bool is_immortal (shared const * s) noexcept {
+            return s->count.load (std::memory_order_relaxed)
+                == immortal_count;
+        }
 
         /**
         Use an allocator to construct an object of type "Type" and return a
@@ -157,6 +276,91 @@ namespace utility {
 
     };
 
+    /**
+    Variant of utility::shared that keeps the count in a cache line of its own.
+    This can be used with small_ptr instead of utility::shared.
+
+    With utility::shared, the count is next to the fields of the derived class.
+    If one thread changes those fields while other threads copy pointers to the
+    object, the threads keep taking the cache line from each other, even though
+    they use different data ("false sharing").
+    This class is aligned to, and fills, a cache line, so that the fields of the
+    derived class start in the next one.
+    This costs memory, so it is only worth it for objects that are shared and
+    written to at the same time.
+
+    The objects are over-aligned.
+    pointer_policy::allocate_and_construct takes care of that.
+    */
+    class alignas (64) padded_shared : public shared {
+    public:
+        /// The size of a cache line that this assumes.
+        static constexpr std::size_t cache_line_size = 64;
+
+    private:
+        char padding [cache_line_size - sizeof (shared)];
+
+    protected:
+        padded_shared() noexcept {}
+
+        // The copy and move constructors mustn't copy the count.
+        padded_shared (padded_shared const &) noexcept : shared() {}
+        padded_shared (padded_shared &&) noexcept : shared() {}
+
+        // Assignment mustn't copy the count.
+        padded_shared & operator = (padded_shared const &) noexcept
+        { return *this; }
+        padded_shared & operator = (padded_shared &&) noexcept
+        { return *this; }
+    };
+
+    /**
+    Base class for reference-counted objects that are only ever accessed from
+    one thread.
+    The count is a plain integer, so acquiring and releasing references is
+    cheaper than for utility::shared.
+    The object and all pointers to it must stay in the thread that constructed
+    it.
+    \sa local_small_ptr
+    */
+    class local_shared {
+    private:
+        long count;
+
+    protected:
+        local_shared() noexcept : count (0l) {}
+
+        // The copy and move constructors mustn't copy the count.
+        local_shared (local_shared const &) noexcept : count (0l) {}
+        local_shared (local_shared &&) noexcept : count (0l) {}
+
+        // Assignment mustn't copy the count.
+        local_shared & operator = (local_shared const &) noexcept
+        { return *this; }
+        local_shared & operator = (local_shared &&) noexcept { return *this; }
+
+    public:
+        /**
+        Register as an owner of the object.
+        Call release_count later to deregister.
+        */
+        static void acquire (local_shared * s) noexcept { ++ s->count; }
+
+        /**
+        Release a reference to a local_shared object.
+        \return true iff this was the last reference, i.e. iff the object must
+        be deleted.
+        */
+        static bool release_count (local_shared * s) noexcept
+        { return ! -- s->count; }
+
+        /**
+        \return The current number of owners of this object.
+        */
+        static long get_count (local_shared const * s) noexcept
+        { return s->count; }
+    };
+
 } // namespace utility
 
 #endif // UTILITY_SHARED_HPP_INCLUDED
@@ -0,0 +1,307 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Instrumentation of intrusive reference counts, per object type.
+
+If UTILITY_SHARED_INSTRUMENTATION is defined before pointer_policy.hpp is
+included, pointers with intrusive reference counts, like small_ptr, record for
+the type of object they point to:
+-   the number of objects constructed through the pointer's construct();
+-   the number of references acquired;
+-   the number of references released;
+-   the number of objects destructed;
+-   the peak number of live objects.
+All translation units in a program must agree on whether the macro is
+defined.
+
+Objects are counted as constructed only if they are constructed through the
+pointer's construct(), or taken over from a unique_small_ptr.
+Objects that a pointer adopts in another way, from a raw pointer or with
+adopt_reference, are not, but their destructions are still counted.
+In programs that do this, the number of live objects is too low, and can be
+negative.
+Destructions are counted however the last reference is released, including
+through deferred releases and references that are handed back to the owner of
+a utility::biased_shared object.
+If it is not defined, the pointers do not call into this file, and their code
+is exactly as without instrumentation.
+
+The counts for acquire and release are kept in tables local to each thread, and
+updated without atomic read-modify-write operations, so they do not cause
+contention.
+Only the counts of live objects are kept globally, with atomic operations, so
+that their peak is meaningful.
+snapshot() and dump() combine the tables of all threads.
+
+The hooks are called from functions that must not throw, so they do not
+allocate memory.
+Up to 256 types are counted separately; any further types are counted
+together.
+*/
+
+#ifndef UTILITY_SHARED_INSTRUMENTATION_HPP_INCLUDED
+#define UTILITY_SHARED_INSTRUMENTATION_HPP_INCLUDED
+
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <typeinfo>
+#include <algorithm>
+#include <ostream>
+
+#include <boost/core/demangle.hpp>
+
+namespace utility { namespace shared_instrumentation {
+
+    /**
+    Statistics for one type of object.
+    */
+    struct type_statistics {
+        std::string name;
+        long constructions;
+        long acquires;
+        long releases;
+        long destructions;
+        long live;
+        long peak_live;
+    };
+
+    namespace detail {
+
+        /// The maximum number of types that are counted separately.
+        static constexpr std::size_t max_types = 256;
+
+        enum counter { acquire_counter, release_counter, counter_num };
+
+        /**
+        Counts for all types for one thread.
+        Only the owning thread writes to them, but other threads read them.
+        */
+        struct thread_table {
+            std::atomic <long> counts [max_types] [counter_num];
+            /// The next table in the registry's list.
+            thread_table * next;
+
+            thread_table() noexcept : next (nullptr) {
+                for (auto & type_counts : counts)
+                    for (auto & count : type_counts)
+                        count.store (0, std::memory_order_relaxed);
+            }
+
+            void increment (std::size_t type, counter c) noexcept {
+                std::atomic <long> & count = counts [type] [c];
+                count.store (count.load (std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+            }
+        };
+
+        /**
+        Global information for one type.
+        The name is only worked out when statistics are collected, so that
+        the hooks never allocate memory.
+        */
+        struct type_entry {
+            /// The type, or null for the entry that collects other types.
+            std::type_info const * type;
+            std::atomic <long> constructions;
+            std::atomic <long> destructions;
+            std::atomic <long> live;
+            std::atomic <long> peak_live;
+
+            type_entry() noexcept
+            : type (nullptr), constructions (0), destructions (0), live (0),
+                peak_live (0) {}
+        };
+
+        /**
+        Global registry of types and thread tables.
+        It is only locked when a type is first used, when a thread starts or
+        exits, and when statistics are collected.
+        It has a fixed size, since it is used from the hooks, which are called
+        from functions that must not throw.
+        */
+        struct registry {
+            std::mutex mutex;
+            type_entry types [max_types];
+            std::size_t type_count;
+            /// List of the tables of threads that are running.
+            thread_table * first_table;
+            /// Counts from threads that have exited.
+            thread_table exited;
+
+            registry() noexcept : type_count (0), first_table (nullptr) {}
+
+            static registry & get() noexcept {
+                static registry instance;
+                return instance;
+            }
+
+            /**
+            \return The index for \a type.
+            Types beyond max_types share the last index.
+            */
+            std::size_t add_type (std::type_info const & type) noexcept {
+                std::lock_guard <std::mutex> lock (mutex);
+                if (type_count < max_types - 1) {
+                    types [type_count].type = &type;
+                    return type_count ++;
+                }
+                // The last entry collects all other types.
+                type_count = max_types;
+                return max_types - 1;
+            }
+        };
+
+        /**
+        Registers the table for the current thread, and adds its counts to the
+        global counts when the thread exits.
+        */
+        class thread_table_owner {
+        public:
+            thread_table table;
+
+            thread_table_owner() noexcept {
+                registry & r = registry::get();
+                std::lock_guard <std::mutex> lock (r.mutex);
+                table.next = r.first_table;
+                r.first_table = &table;
+            }
+
+            ~thread_table_owner() noexcept {
+                registry & r = registry::get();
+                std::lock_guard <std::mutex> lock (r.mutex);
+                for (std::size_t type = 0; type != max_types; ++ type)
+                    for (int c = 0; c != counter_num; ++ c)
+                        r.exited.counts [type] [c].fetch_add (
+                            table.counts [type] [c].load (
+                                std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+                thread_table ** current = &r.first_table;
+                while (*current != &table)
+                    current = &(*current)->next;
+                *current = table.next;
+            }
+        };
+
+        inline thread_table & current_table() noexcept {
+            static thread_local thread_table_owner owner;
+            return owner.table;
+        }
+
+        /// \return The index of Type in the tables.
+        template <class Type> inline std::size_t type_index() noexcept {
+            static std::size_t const index
+                = registry::get().add_type (typeid (Type));
+            return index;
+        }
+
+        template <class Type> inline type_entry & entry() noexcept
+        { return registry::get().types [type_index <Type>()]; }
+
+    } // namespace detail
+
+    /* Hooks, which are called by intrusive_reference_count. */
+
+    template <class Type> inline void on_construct() noexcept {
+        detail::type_entry & e = detail::entry <Type>();
+        e.constructions.fetch_add (1, std::memory_order_relaxed);
+        long live = e.live.fetch_add (1, std::memory_order_relaxed) + 1;
+        long peak = e.peak_live.load (std::memory_order_relaxed);
+        while (peak < live && !e.peak_live.compare_exchange_weak (
+                peak, live, std::memory_order_relaxed))
+        {}
+    }
+
+    template <class Type> inline void on_acquire() noexcept {
+        detail::current_table().increment (
+            detail::type_index <Type>(), detail::acquire_counter);
+    }
+
+    template <class Type> inline void on_release() noexcept {
+        detail::current_table().increment (
+            detail::type_index <Type>(), detail::release_counter);
+    }
+
+    template <class Type> inline void on_destruct() noexcept {
+        detail::type_entry & e = detail::entry <Type>();
+        e.destructions.fetch_add (1, std::memory_order_relaxed);
+        e.live.fetch_sub (1, std::memory_order_relaxed);
+    }
+
+    /* Reporting. */
+
+    /**
+    \return The statistics for all types that have been used, sorted by the
+    number of acquires and releases, most first.
+    Counts from other threads that are running may be slightly out of date.
+    */
+    inline std::vector <type_statistics> snapshot() {
+        detail::registry & r = detail::registry::get();
+        std::lock_guard <std::mutex> lock (r.mutex);
+        std::vector <type_statistics> result;
+        for (std::size_t type = 0; type != r.type_count; ++ type) {
+            detail::type_entry const & e = r.types [type];
+            type_statistics statistics;
+            statistics.name = e.type
+                ? boost::core::demangle (e.type->name()) : "(other types)";
+            statistics.constructions
+                = e.constructions.load (std::memory_order_relaxed);
+            statistics.destructions
+                = e.destructions.load (std::memory_order_relaxed);
+            statistics.live = e.live.load (std::memory_order_relaxed);
+            statistics.peak_live = e.peak_live.load (std::memory_order_relaxed);
+
+            long counts [detail::counter_num];
+            for (int c = 0; c != detail::counter_num; ++ c) {
+                counts [c] = r.exited.counts [type] [c].load (
+                    std::memory_order_relaxed);
+                for (detail::thread_table const * table = r.first_table;
+                        table; table = table->next)
+                    counts [c] += table->counts [type] [c].load (
+                        std::memory_order_relaxed);
+            }
+            statistics.acquires = counts [detail::acquire_counter];
+            statistics.releases = counts [detail::release_counter];
+            result.push_back (statistics);
+        }
+        std::sort (result.begin(), result.end(),
+            [] (type_statistics const & one, type_statistics const & other) {
+                return one.acquires + one.releases
+                    > other.acquires + other.releases;
+            });
+        return result;
+    }
+
+    /**
+    Write the statistics for all types to \a stream, one line per type.
+    */
+    inline void dump (std::ostream & stream) {
+        stream << "acquires\treleases\tconstructed\tdestructed\tlive\t"
+            "peak live\ttype\n";
+        for (type_statistics const & statistics : snapshot())
+            stream << statistics.acquires << '\t'
+                << statistics.releases << '\t'
+                << statistics.constructions << '\t'
+                << statistics.destructions << '\t' << statistics.live << '\t'
+                << statistics.peak_live << '\t' << statistics.name << '\n';
+    }
+
+}} // namespace utility::shared_instrumentation
+
+#endif // UTILITY_SHARED_INSTRUMENTATION_HPP_INCLUDED
@@ -28,20 +28,111 @@ namespace utility {
     template <class Type, class Allocator = std::allocator <Type>>
         class small_ptr;
 
+    template <class Type, class Allocator = std::allocator <Type>>
+        class local_small_ptr;
+
+    template <class Type, class Allocator = std::allocator <Type>>
+        class unique_small_ptr;
+
+    template <class Type, class Allocator = std::allocator <Type>>
+        class deferred_small_ptr;
+
+    template <class Type, class Allocator = std::allocator <Type>>
+        class cow_ptr;
+
+    template <class Type, class Allocator = std::allocator <Type>>
+        class counted_small_ptr;
+
+    template <class Type, class Allocator = std::allocator <Type>>
+        class epoch_ptr;
+
+    template <class Type> class arena_ptr;
+
+    template <class Type, class Region> class compact_ptr;
+
+    template <class Type, unsigned TagBits,
+        class Allocator = std::allocator <Type>>
+    class tagged_small_ptr;
+
     namespace detail {
 
-        template <class Type, class Allocator> class small_ptr_policies {
-            typedef pointer_policy::use_allocator <Type, Allocator>
-                use_allocator;
-
-            // Use with_recursive_type if move_recursive_next is implemented for
-            // Type.
-            typedef typename std::conditional <
-                    std::is_base_of <
-                        pointer_policy::move_recursive_next_not_available,
-                        pointer_policy::move_recursive_next <Type>>::value,
-                    use_allocator,
-                    pointer_policy::with_recursive_type <use_allocator>>::type
+        /**
+        Wrap \a Storage in with_recursive_children if move_recursive_children
+        is implemented for its value type, or else in with_recursive_type if
+        move_recursive_next is.
+        */
+        template <class Storage> struct maybe_recursive_storage
+        : std::conditional <
+            std::is_base_of <
+                pointer_policy::move_recursive_children_not_available,
+                pointer_policy::move_recursive_children <
+                    typename Storage::value_type>>::value,
+            typename std::conditional <
+                std::is_base_of <
+                    pointer_policy::move_recursive_next_not_available,
+                    pointer_policy::move_recursive_next <
+                        typename Storage::value_type>>::value,
+                Storage,
+                pointer_policy::with_recursive_type <Storage>>::type,
+            pointer_policy::with_recursive_children <Storage>> {};
+
+        template <class Type, class Allocator,
+            template <class> class Lifetime
+                = pointer_policy::reference_count_shared,
+            template <class> class Access = pointer_policy::pointer_access>
+        class small_ptr_policies
+        {
+            typedef typename maybe_recursive_storage <
+                    pointer_policy::use_allocator <Type, Allocator>>::type
+                storage_policy;
+
+        public:
+            typedef pointer_policy::strict_weak_ordered <
+                Access <Lifetime <storage_policy>>> type;
+        };
+
+        template <class Type, class Allocator>
+            class counted_small_ptr_policies
+        {
+            typedef typename maybe_recursive_storage <
+                    pointer_policy::use_allocator_with_count <
+                        Type, Allocator>>::type
+                storage_policy;
+
+        public:
+            typedef pointer_policy::strict_weak_ordered <
+                pointer_policy::pointer_access <
+                pointer_policy::reference_count_prefix <storage_policy>>> type;
+        };
+
+        template <class Type, unsigned TagBits, class Allocator>
+            class tagged_small_ptr_policies
+        {
+            typedef typename maybe_recursive_storage <
+                    pointer_policy::use_allocator_tagged <
+                        Type, Allocator, TagBits>>::type
+                storage_policy;
+
+        public:
+            typedef pointer_policy::strict_weak_ordered <
+                pointer_policy::pointer_access <
+                pointer_policy::reference_count_shared <storage_policy>>> type;
+        };
+
+        template <class Type, class Region> class compact_ptr_policies {
+            typedef typename maybe_recursive_storage <
+                    pointer_policy::use_region_index <Type, Region>>::type
+                storage_policy;
+
+        public:
+            typedef pointer_policy::strict_weak_ordered <
+                pointer_policy::pointer_access <
+                pointer_policy::reference_count_shared <storage_policy>>> type;
+        };
+
+        template <class Type> class arena_ptr_policies {
+            typedef typename maybe_recursive_storage <
+                    pointer_policy::use_arena <Type>>::type
                 storage_policy;
 
         public:
@@ -56,6 +147,14 @@ namespace utility {
     Smart pointer to an object of known type.
     Since it uses an allocator, it has a fixed type.
     The type must derive from utility::shared.
+    Alternatively, if it is mostly used from one thread, it can derive from
+    utility::biased_shared; and if it is copied very often from many threads, it
+    can derive from utility::sharded_shared.
+    For small objects, it can derive from utility::compact_shared, which uses a
+    smaller count.
+    If it derives from utility::weak_shared, weak_small_ptr can refer to it.
+    The implementation of the reference count is selected based on the base
+    class.
 
     small_ptr is meant as an efficient type to be used inside containers.
 
@@ -63,6 +162,8 @@ namespace utility {
     should specialise pointer_policy::move_recursive_next.
     This will make destruction of a chain of objects iterative instead of
     recursive, and thus avert stack overflows.
+    If it contains more than one, as in a tree, specialise
+    pointer_policy::move_recursive_children instead.
     */
     template <class Type, class Allocator> class small_ptr
     : public pointer_policy::pointer <
@@ -77,6 +178,16 @@ namespace utility {
             explicit small_ptr (Arguments && ... arguments)
         : base_type (std::forward <Arguments> (arguments) ...) {}
 
+        /**
+        Take over the object from a unique_small_ptr, which becomes empty.
+        The object is not reallocated.
+        If \a Type derives from utility::shared, the count is set with a
+        plain store, not with an atomic read-modify-write.
+        */
+        small_ptr (unique_small_ptr <Type, Allocator> && that) noexcept
+        : base_type (pointer_policy::adopt_unique(),
+            that.release(), that.allocator()) {}
+
         small_ptr (small_ptr const &) = default;
         small_ptr (small_ptr &&) = default;
 
@@ -84,6 +195,318 @@ namespace utility {
         small_ptr & operator = (small_ptr &&) = default;
     };
 
+    /**
+    Smart pointer like small_ptr, but with a non-atomic reference count.
+    The type must derive from utility::local_shared.
+
+    This is faster than small_ptr, but the object and all pointers to it must
+    be used from one thread only.
+    Like for small_ptr, pointer_policy::move_recursive_next can be specialised
+    to make destruction of a chain of objects iterative.
+    */
+    template <class Type, class Allocator> class local_small_ptr
+    : public pointer_policy::pointer <
+        typename detail::small_ptr_policies <Type, Allocator,
+            pointer_policy::reference_count_local>::type,
+        local_small_ptr <Type, Allocator>>
+    {
+        typedef typename detail::small_ptr_policies <Type, Allocator,
+            pointer_policy::reference_count_local>::type policies_type;
+        typedef pointer_policy::pointer <policies_type, local_small_ptr>
+            base_type;
+    public:
+        template <class ... Arguments>
+            explicit local_small_ptr (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        local_small_ptr (local_small_ptr const &) = default;
+        local_small_ptr (local_small_ptr &&) = default;
+
+        local_small_ptr & operator = (local_small_ptr const &) = default;
+        local_small_ptr & operator = (local_small_ptr &&) = default;
+    };
+
+    /**
+    Smart pointer with unique ownership, like std::unique_ptr, but which uses an
+    allocator, like small_ptr.
+    It is move-only, and has no reference count, so the type can be any type.
+
+    If the type derives from a class that small_ptr supports, a
+    unique_small_ptr can be moved into a small_ptr.
+    This makes it possible to construct and modify an object in one thread
+    without touching the atomic count, and then share it.
+    Like for small_ptr, pointer_policy::move_recursive_next can be specialised
+    to make destruction of a chain of objects iterative.
+    */
+    template <class Type, class Allocator> class unique_small_ptr
+    : public pointer_policy::pointer <
+        typename detail::small_ptr_policies <Type, Allocator,
+            pointer_policy::unique_owner>::type,
+        unique_small_ptr <Type, Allocator>>
+    {
+        typedef typename detail::small_ptr_policies <Type, Allocator,
+            pointer_policy::unique_owner>::type policies_type;
+        typedef pointer_policy::pointer <policies_type, unique_small_ptr>
+            base_type;
+    public:
+        template <class ... Arguments>
+            explicit unique_small_ptr (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        unique_small_ptr (unique_small_ptr const &) = delete;
+        unique_small_ptr (unique_small_ptr &&) = default;
+
+        unique_small_ptr & operator = (unique_small_ptr const &) = delete;
+        unique_small_ptr & operator = (unique_small_ptr &&) = default;
+    };
+
+    /**
+    Pointer with copy-on-write semantics, which can be used as a value type.
+    Like small_ptr, it is the size of a plain pointer, and the type must derive
+    from one of the classes that small_ptr supports, except for
+    utility::biased_shared and utility::sharded_shared.
+    Their use count is not always exact, so write() could fail to copy an
+    object that other pointers share.
+    Copying a cow_ptr shares the object.
+    Const access through operator* and operator-> never copies.
+    write() returns a mutable reference to the object, and first copies it,
+    with the same allocator, if other pointers share it.
+
+    \code
+    cow_ptr <document> d2 = d1;
+    d2.write().title = "Copy";
+    \endcode
+    */
+    template <class Type, class Allocator> class cow_ptr
+    : public pointer_policy::pointer <
+        typename detail::small_ptr_policies <Type, Allocator,
+            pointer_policy::reference_count_shared,
+            pointer_policy::copy_on_write_access>::type,
+        cow_ptr <Type, Allocator>>
+    {
+        typedef typename detail::small_ptr_policies <Type, Allocator,
+            pointer_policy::reference_count_shared,
+            pointer_policy::copy_on_write_access>::type policies_type;
+        typedef pointer_policy::pointer <policies_type, cow_ptr> base_type;
+    public:
+        template <class ... Arguments>
+            explicit cow_ptr (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        cow_ptr (cow_ptr const &) = default;
+        cow_ptr (cow_ptr &&) = default;
+
+        cow_ptr & operator = (cow_ptr const &) = default;
+        cow_ptr & operator = (cow_ptr &&) = default;
+    };
+
+    /**
+    Smart pointer like small_ptr, for objects of any type.
+    The object does not need to derive from utility::shared: the reference
+    count is allocated right before the object, in the same allocation, with
+    the allocator rebound.
+    The pointer is the size of a plain pointer, unlike std::shared_ptr.
+    Like for small_ptr, pointer_policy::move_recursive_next can be specialised
+    to make destruction of a chain of objects iterative.
+    */
+    template <class Type, class Allocator> class counted_small_ptr
+    : public pointer_policy::pointer <
+        typename detail::counted_small_ptr_policies <Type, Allocator>::type,
+        counted_small_ptr <Type, Allocator>>
+    {
+        typedef typename detail::counted_small_ptr_policies <
+            Type, Allocator>::type policies_type;
+        typedef pointer_policy::pointer <policies_type, counted_small_ptr>
+            base_type;
+    public:
+        template <class ... Arguments>
+            explicit counted_small_ptr (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        counted_small_ptr (counted_small_ptr const &) = default;
+        counted_small_ptr (counted_small_ptr &&) = default;
+
+        counted_small_ptr & operator = (counted_small_ptr const &) = default;
+        counted_small_ptr & operator = (counted_small_ptr &&) = default;
+    };
+
+    /**
+    Smart pointer like small_ptr, but which defers releases of references.
+    The type must derive from utility::shared.
+
+    Releases are collected in a buffer local to the thread, and repeated
+    releases of the same object are coalesced.
+    An acquire of an object with a pending release cancels the release, so that
+    the count is not touched at all.
+    The releases are applied when pointer_policy::flush_deferred_releases() is
+    called, when the buffer needs space, or when the thread exits.
+    Objects are only destructed then.
+    use_count() does not include the releases that are pending in the current
+    thread.
+    */
+    template <class Type, class Allocator> class deferred_small_ptr
+    : public pointer_policy::pointer <
+        typename detail::small_ptr_policies <Type, Allocator,
+            pointer_policy::reference_count_deferred>::type,
+        deferred_small_ptr <Type, Allocator>>
+    {
+        typedef typename detail::small_ptr_policies <Type, Allocator,
+            pointer_policy::reference_count_deferred>::type policies_type;
+        typedef pointer_policy::pointer <policies_type, deferred_small_ptr>
+            base_type;
+    public:
+        template <class ... Arguments>
+            explicit deferred_small_ptr (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        deferred_small_ptr (deferred_small_ptr const &) = default;
+        deferred_small_ptr (deferred_small_ptr &&) = default;
+
+        deferred_small_ptr & operator = (deferred_small_ptr const &) = default;
+        deferred_small_ptr & operator = (deferred_small_ptr &&) = default;
+    };
+
+    /**
+    Pointer to an object that is reclaimed with epoch-based reclamation.
+    This is meant for read-mostly data structures, whose readers should not
+    write to shared memory.
+    The type does not need to derive from anything.
+
+    Copying and destructing an epoch_ptr are as cheap as for a plain pointer.
+    Readers must hold an epoch::guard while they use objects that other
+    threads may retire.
+    A writer unlinks an object and then calls retire() on a pointer to it.
+    The object is destructed when no thread can be reading it any more.
+    \sa pointer_policy::epoch_reclamation
+    */
+    template <class Type, class Allocator> class epoch_ptr
+    : public pointer_policy::pointer <
+        pointer_policy::strict_weak_ordered <
+            pointer_policy::pointer_access <
+                pointer_policy::epoch_reclamation <
+                    pointer_policy::use_allocator <Type, Allocator>>>>,
+        epoch_ptr <Type, Allocator>>
+    {
+        typedef pointer_policy::strict_weak_ordered <
+            pointer_policy::pointer_access <
+                pointer_policy::epoch_reclamation <
+                    pointer_policy::use_allocator <Type, Allocator>>>>
+            policies_type;
+        typedef pointer_policy::pointer <policies_type, epoch_ptr> base_type;
+    public:
+        template <class ... Arguments>
+            explicit epoch_ptr (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        epoch_ptr (epoch_ptr const &) = default;
+        epoch_ptr (epoch_ptr &&) = default;
+
+        epoch_ptr & operator = (epoch_ptr const &) = default;
+        epoch_ptr & operator = (epoch_ptr &&) = default;
+    };
+
+    /**
+    Smart pointer like small_ptr, that also holds a tag of \a TagBits bits, in
+    the lowest bits of the pointer.
+    \a TagBits can be at most log2 (alignof (Type)); for types that derive from
+    utility::shared, this is usually 3.
+    With a stateless allocator, this is as large as a plain pointer.
+
+    tag() returns the tag, and set_tag() sets it.
+    The tag belongs to the pointer, not to the object: copies get the same tag,
+    but changing the tag does not affect other pointers.
+    Comparisons ignore the tag.
+    \sa pointer_policy::use_allocator_tagged
+    */
+    template <class Type, unsigned TagBits, class Allocator>
+        class tagged_small_ptr
+    : public pointer_policy::pointer <
+        typename detail::tagged_small_ptr_policies <
+            Type, TagBits, Allocator>::type,
+        tagged_small_ptr <Type, TagBits, Allocator>>
+    {
+        typedef typename detail::tagged_small_ptr_policies <
+            Type, TagBits, Allocator>::type policies_type;
+        typedef pointer_policy::pointer <policies_type, tagged_small_ptr>
+            base_type;
+    public:
+        template <class ... Arguments>
+            explicit tagged_small_ptr (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        tagged_small_ptr (tagged_small_ptr const &) = default;
+        tagged_small_ptr (tagged_small_ptr &&) = default;
+
+        tagged_small_ptr & operator = (tagged_small_ptr const &) = default;
+        tagged_small_ptr & operator = (tagged_small_ptr &&) = default;
+    };
+
+    /**
+    Smart pointer like small_ptr, to an object in a utility::arena.
+    The type must derive from utility::shared or one of the other count
+    classes that small_ptr supports.
+
+    The reference count works as for small_ptr, and when it goes to zero the
+    object is destructed, unless it is trivially destructible.
+    However, the memory is not deallocated: it is released with the arena.
+    All arena_ptr's must therefore be destructed before the arena is rewound
+    or released.
+    Like for small_ptr, pointer_policy::move_recursive_next can be specialised
+    to make destruction of a chain of objects iterative.
+    \sa pointer_policy::use_arena
+    */
+    template <class Type> class arena_ptr
+    : public pointer_policy::pointer <
+        typename detail::arena_ptr_policies <Type>::type, arena_ptr <Type>>
+    {
+        typedef typename detail::arena_ptr_policies <Type>::type
+            policies_type;
+        typedef pointer_policy::pointer <policies_type, arena_ptr> base_type;
+    public:
+        template <class ... Arguments>
+            explicit arena_ptr (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        arena_ptr (arena_ptr const &) = default;
+        arena_ptr (arena_ptr &&) = default;
+
+        arena_ptr & operator = (arena_ptr const &) = default;
+        arena_ptr & operator = (arena_ptr &&) = default;
+    };
+
+    /**
+    Smart pointer like small_ptr, that takes only 4 bytes, because it holds a
+    32-bit index into a region, usually a utility::compact_region, instead of
+    a pointer.
+    The type must derive from utility::shared or one of the other count
+    classes that small_ptr supports; utility::compact_shared <std::uint32_t>
+    keeps the count small too.
+
+    construct() takes the arguments to the constructor of the object only.
+    Like for small_ptr, pointer_policy::move_recursive_next can be specialised
+    to make destruction of a chain of objects iterative.
+    \sa pointer_policy::use_region_index
+    */
+    template <class Type, class Region> class compact_ptr
+    : public pointer_policy::pointer <
+        typename detail::compact_ptr_policies <Type, Region>::type,
+        compact_ptr <Type, Region>>
+    {
+        typedef typename detail::compact_ptr_policies <Type, Region>::type
+            policies_type;
+        typedef pointer_policy::pointer <policies_type, compact_ptr> base_type;
+    public:
+        template <class ... Arguments>
+            explicit compact_ptr (Arguments && ... arguments)
+        : base_type (std::forward <Arguments> (arguments) ...) {}
+
+        compact_ptr (compact_ptr const &) = default;
+        compact_ptr (compact_ptr &&) = default;
+
+        compact_ptr & operator = (compact_ptr const &) = default;
+        compact_ptr & operator = (compact_ptr &&) = default;
+    };
+
 }   // namespace utility
 
 #endif // UTILITY_SMALL_PTR_HPP_INCLUDED
@@ -0,0 +1,249 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef UTILITY_WEAK_SHARED_HPP_INCLUDED
+#define UTILITY_WEAK_SHARED_HPP_INCLUDED
+
+#include <cstddef>
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+#include "config.hpp"
+
+namespace utility {
+
+    /**
+    Base class for reference-counted objects that weak pointers can refer to.
+    This can be used with small_ptr instead of utility::shared, and then
+    weak_small_ptr can refer to the object.
+
+    Apart from the count of owners, this keeps a count of weak references.
+    All owners together hold one weak reference.
+    When the last owner is released, the object is destructed, and that weak
+    reference is released.
+    When the last weak reference is released, the memory is deallocated.
+    The counts are kept in the memory of the object itself, so no separate
+    control block is needed.
+
+    Weak pointers use the counts after the object has been destructed, but
+    before its memory has been deallocated.
+    Referring to members or base classes of an object after its destructor has
+    run is undefined behaviour.
+    Therefore, the counts are not members: they are constructed in raw storage
+    inside this class, so that they are separate objects, which stay alive
+    until the memory is deallocated.
+    Pointers to them must be found while the object is alive; see
+    weak_shared_detail::counts_location.
+    weak_shared must not be a virtual base class.
+    */
+    class weak_shared {
+    public:
+        /**
+        The counts of one object.
+        */
+        struct counts {
+            std::atomic <long> strong;
+            std::atomic <long> weak;
+
+            counts() noexcept : strong (0l), weak (1l) {}
+        };
+
+    private:
+        std::aligned_storage <sizeof (counts), alignof (counts)>::type
+            counts_storage;
+
+        void construct_counts() noexcept { new (&counts_storage) counts(); }
+
+    protected:
+        weak_shared() noexcept { construct_counts(); }
+
+        // The copy and move constructors mustn't copy the counts.
+        weak_shared (weak_shared const &) noexcept { construct_counts(); }
+        weak_shared (weak_shared &&) noexcept { construct_counts(); }
+
+        // Assignment mustn't copy the counts.
+        weak_shared & operator = (weak_shared const &) noexcept
+        { return *this; }
+        weak_shared & operator = (weak_shared &&) noexcept
+        { return *this; }
+
+        // The counts are trivially destructible, and must outlive this, so
+        // they are not destructed.
+
+    public:
+        /**
+        \return The counts of \a s, which must be alive.
+        The result remains valid after the object has been destructed, until
+        its memory is deallocated.
+        */
+        static counts * counts_of (weak_shared * s) noexcept
+        { return reinterpret_cast <counts *> (&s->counts_storage); }
+        static counts const * counts_of (weak_shared const * s) noexcept
+        { return reinterpret_cast <counts const *> (&s->counts_storage); }
+
+        /* Operations on the count of owners. */
+
+        /**
+        Register as an owner of the object.
+        Call release_count later to deregister.
+        */
+        static void acquire (weak_shared * s) noexcept
+        { counts_of (s)->strong.fetch_add (1, std::memory_order_relaxed); }
+
+        /**
+        Register the first owner of an object that has never been owned
+        through its count.
+        */
+        static void acquire_first (weak_shared * s) noexcept
+        { counts_of (s)->strong.store (1, std::memory_order_relaxed); }
+
+        /**
+        Register as an owner of the object, but only if it has an owner
+        already.
+        This is lock-free, and is used to turn a weak reference into an owner.
+        The object may have been destructed.
+        \return true iff this is now an owner; false iff the count was zero.
+        */
+        static bool try_acquire (counts * c) noexcept {
+            long count = c->strong.load (std::memory_order_relaxed);
+            do {
+                if (count == 0)
+                    return false;
+            } while (!c->strong.compare_exchange_weak (
+                count, count + 1, std::memory_order_relaxed));
+            return true;
+        }
+
+        /**
+        Release a reference to the object.
+        \return true iff this was the last reference, i.e. iff the object must
+        be destructed.
+        */
+        static bool release_count (weak_shared * s) noexcept {
+            if (counts_of (s)->strong.fetch_sub (
+                    1, UTILITY_CONFIG_RELEASE_COUNT_ORDER) == 1)
+            {
+                std::atomic_thread_fence (std::memory_order_acquire);
+                return true;
+            }
+            return false;
+        }
+
+        /**
+        \return The current number of owners of the object, which may have
+        been destructed.
+        */
+        static long get_count (counts const * c) noexcept
+        { return c->strong.load (std::memory_order_relaxed); }
+        static long get_count (weak_shared const * s) noexcept
+        { return get_count (counts_of (s)); }
+
+        /* Operations on the count of weak references. */
+
+        /**
+        Register as a weak reference to the object, which may have been
+        destructed.
+        Call release_weak later to deregister.
+        */
+        static void acquire_weak (counts * c) noexcept
+        { c->weak.fetch_add (1, std::memory_order_relaxed); }
+
+        /**
+        Release a weak reference.
+        This is also called once the object has been destructed, with the
+        counts that were found before that.
+        \return true iff this was the last weak reference, i.e. iff the memory
+        must be deallocated.
+        */
+        static bool release_weak (counts * c) noexcept {
+            if (c->weak.fetch_sub (1, UTILITY_CONFIG_RELEASE_COUNT_ORDER)
+                    == 1)
+            {
+                std::atomic_thread_fence (std::memory_order_acquire);
+                return true;
+            }
+            return false;
+        }
+
+        /**
+        \return The current number of weak references, plus one if the object
+        has not been destructed yet.
+        */
+        static long get_weak_count (weak_shared const * s) noexcept
+        { return counts_of (s)->weak.load (std::memory_order_relaxed); }
+    };
+
+    namespace weak_shared_detail {
+
+        /**
+        \return The counts of \a object, or nullptr if it is not derived from
+        weak_shared.
+        This must be called before the object is destructed.
+        */
+        inline weak_shared::counts * counts_of_live (weak_shared * object)
+            noexcept
+        { return weak_shared::counts_of (object); }
+        inline weak_shared::counts * counts_of_live (void const *) noexcept
+        { return nullptr; }
+
+        /**
+        Find the counts of objects of type Type that may have been destructed.
+        Converting a pointer to such an object to a pointer to its base class
+        is undefined behaviour.
+        Therefore, the offset of the counts from the address of the object is
+        recorded whenever they are found from an object that is alive.
+        It is the same for all objects of type Type.
+        */
+        template <class Type> class counts_location {
+            static std::atomic <std::ptrdiff_t> & offset() noexcept {
+                static std::atomic <std::ptrdiff_t> value (0);
+                return value;
+            }
+
+            static char * address (Type * object) noexcept
+            { return static_cast <char *> (static_cast <void *> (object)); }
+
+        public:
+            /**
+            \return The counts of \a object, which must be alive.
+            */
+            static weak_shared::counts * of_live (Type * object) noexcept {
+                weak_shared::counts * c = weak_shared::counts_of (object);
+                offset().store (
+                    reinterpret_cast <char *> (c) - address (object),
+                    std::memory_order_relaxed);
+                return c;
+            }
+
+            /**
+            \return The counts of \a object, which may have been destructed.
+            \pre of_live has been called on an object of type Type, and this
+            happens after it, for example because it is called through a weak
+            pointer that was constructed from a pointer that owned an object.
+            */
+            static weak_shared::counts * of_any (Type * object) noexcept {
+                return reinterpret_cast <weak_shared::counts *> (
+                    address (object)
+                    + offset().load (std::memory_order_relaxed));
+            }
+        };
+
+    } // namespace weak_shared_detail
+
+} // namespace utility
+
+#endif // UTILITY_WEAK_SHARED_HPP_INCLUDED
@@ -0,0 +1,167 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef UTILITY_WEAK_SMALL_PTR_HPP_INCLUDED
+#define UTILITY_WEAK_SMALL_PTR_HPP_INCLUDED
+
+#include <memory>
+#include <type_traits>
+
+#include "weak_shared.hpp"
+#include "small_ptr.hpp"
+
+namespace utility {
+
+    /**
+    Weak reference to an object owned by small_ptr.
+    The type must derive from utility::weak_shared.
+
+    This does not keep the object alive, but it does keep its memory allocated,
+    so that lock() can check whether the object is still alive.
+    The counts are kept in the object itself, so unlike std::weak_ptr, this
+    does not need a separate control block.
+    Once the object has been destructed, this only uses the counts, which
+    utility::weak_shared keeps alive until the memory is deallocated.
+    The memory is deallocated with the allocator of the last weak reference, or
+    of the last owner if no weak references remain when it is released.
+    */
+    template <class Type, class Allocator = std::allocator <Type>>
+        class weak_small_ptr
+    : private pointer_policy::use_allocator <Type, Allocator>
+    {
+        typedef pointer_policy::use_allocator <Type, Allocator> storage_type;
+    public:
+        typedef Type value_type;
+        typedef small_ptr <Type, Allocator> strong_type;
+
+        /**
+        Construct an empty weak pointer.
+        */
+        explicit weak_small_ptr (Allocator const & allocator = Allocator())
+        : storage_type (allocator) {}
+
+        /**
+        Construct a weak reference to the object that \a that owns.
+        */
+        weak_small_ptr (strong_type const & that) noexcept
+        : storage_type (that.get(), that.allocator())
+        {
+            if (!storage_type::empty())
+                counts_location::of_live (storage_type::object());
+            acquire();
+        }
+
+        weak_small_ptr (weak_small_ptr const & that) noexcept
+        : storage_type (that)
+        { acquire(); }
+
+        weak_small_ptr (weak_small_ptr && that) noexcept
+        : storage_type (std::move (that))
+        { that.storage_type::reset(); }
+
+        ~weak_small_ptr() noexcept { release(); }
+
+        weak_small_ptr & operator = (weak_small_ptr const & that) noexcept {
+            that.acquire();
+            storage_type save = that;
+            release();
+            storage_type::operator = (save);
+            return *this;
+        }
+
+        weak_small_ptr & operator = (weak_small_ptr && that) noexcept {
+            storage_type save = std::move (that);
+            that.storage_type::reset();
+            release();
+            storage_type::operator = (std::move (save));
+            return *this;
+        }
+
+        weak_small_ptr & operator = (strong_type const & that) noexcept
+        { return *this = weak_small_ptr (that); }
+
+        /**
+        \return A pointer that owns the object, or an empty pointer if the
+        object has been destructed.
+        This is lock-free.
+        */
+        strong_type lock() const noexcept {
+            if (!storage_type::empty()
+                    && weak_shared::try_acquire (counts()))
+                return strong_type (pointer_policy::adopt_reference(),
+                    storage_type::object(), storage_type::allocator());
+            return strong_type (storage_type::allocator());
+        }
+
+        /**
+        \return The number of owners of the object, or 0 if this is empty.
+        */
+        long use_count() const noexcept {
+            if (storage_type::empty())
+                return 0;
+            return weak_shared::get_count (counts());
+        }
+
+        /**
+        \return true iff the object has been destructed, or this is empty.
+        */
+        bool expired() const noexcept { return use_count() == 0; }
+
+        /**
+        Make this empty.
+        */
+        void reset() noexcept {
+            release();
+            storage_type::reset();
+        }
+
+        void swap (weak_small_ptr & that) noexcept
+        { storage_type::swap (that); }
+
+        using storage_type::allocator;
+
+    private:
+        typedef weak_shared_detail::counts_location <Type> counts_location;
+
+        /**
+        \return The counts of the object, which may have been destructed.
+        \pre This is not empty.
+        */
+        weak_shared::counts * counts() const noexcept
+        { return counts_location::of_any (storage_type::object()); }
+
+        void acquire() const noexcept {
+            static_assert (std::is_base_of <weak_shared, Type>::value,
+                "The referenced object must derive from utility::weak_shared.");
+            if (!storage_type::empty())
+                weak_shared::acquire_weak (counts());
+        }
+
+        void release() noexcept {
+            if (!storage_type::empty()
+                    && weak_shared::release_weak (counts()))
+                storage_type::deallocate();
+        }
+    };
+
+    template <class Type, class Allocator> inline
+        void swap (weak_small_ptr <Type, Allocator> & one,
+            weak_small_ptr <Type, Allocator> & other) noexcept
+    { one.swap (other); }
+
+} // namespace utility
+
+#endif // UTILITY_WEAK_SMALL_PTR_HPP_INCLUDED
@@ -0,0 +1,146 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_arena
+#include "utility/test/boost_unit_test.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "utility/arena.hpp"
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+struct object : utility::shared {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+struct plain : utility::shared {
+    int value;
+    explicit plain (int value) : value (value) {}
+};
+
+struct node;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <node> {
+        utility::arena_ptr <node> && operator() (node * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+struct node : utility::shared {
+    int value_;
+    utility::arena_ptr <node> next_;
+
+    explicit node (int value) : value_ (value) {}
+};
+
+inline utility::arena_ptr <node> &&
+    utility::pointer_policy::move_recursive_next <node>::operator() (
+        node * object) const
+{ return std::move (object->next_); }
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_arena)
+
+BOOST_AUTO_TEST_CASE (test_utility_arena_allocate) {
+    utility::arena a (64);
+    void * first = a.allocate (8, 8);
+    void * second = a.allocate (8, 8);
+    BOOST_CHECK_EQUAL (static_cast <char *> (second)
+        - static_cast <char *> (first), 8);
+
+    void * aligned = a.allocate (1, 32);
+    BOOST_CHECK_EQUAL (reinterpret_cast <std::uintptr_t> (aligned) % 32, 0u);
+
+    // Larger than a chunk.
+    void * big = a.allocate (1000);
+    static_cast <char *> (big) [999] = 1;
+
+    // Rewind.
+    auto position = a.checkpoint();
+    void * third = a.allocate (16);
+    for (int i = 0; i != 100; ++ i)
+        a.allocate (100);
+    a.rewind (position);
+    BOOST_CHECK_EQUAL (a.allocate (16), third);
+
+    a.release();
+    a.allocate (16);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_arena_allocator) {
+    utility::arena a;
+    utility::arena b;
+    utility::arena_allocator <int> allocator (a);
+    BOOST_CHECK (allocator == utility::arena_allocator <char> (a));
+    BOOST_CHECK (allocator != utility::arena_allocator <int> (b));
+
+    std::vector <int, utility::arena_allocator <int>> v (allocator);
+    for (int i = 0; i != 1000; ++ i)
+        v.push_back (i);
+    BOOST_CHECK_EQUAL (v [999], 999);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_arena_ptr) {
+    static_assert (sizeof (utility::arena_ptr <object>) == sizeof (void *),
+        "");
+
+    utility::tracked_registry registry;
+    utility::arena a;
+    {
+        auto p = utility::arena_ptr <object>::construct (a, registry, 5);
+        {
+            auto q = p;
+            BOOST_CHECK_EQUAL (p.use_count(), 2);
+            BOOST_CHECK_EQUAL (q->value.content(), 5);
+        }
+        BOOST_CHECK (p.unique());
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+    }
+    // The object is destructed when the last reference goes away.
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+
+    // A trivially destructible object.
+    auto position = a.checkpoint();
+    {
+        auto p = utility::arena_ptr <plain>::construct (a, 7);
+        BOOST_CHECK_EQUAL (p->value, 7);
+    }
+    a.rewind (position);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_arena_ptr_list) {
+    utility::arena a;
+    {
+        utility::arena_ptr <node> first;
+        utility::arena_ptr <node> * current = &first;
+        for (int i = 0; i != 100000; ++ i) {
+            *current = utility::arena_ptr <node>::construct (a, i);
+            current = &(*current)->next_;
+        }
+        BOOST_CHECK_EQUAL (first->next_->value_, 1);
+        // Destruction is iterative.
+    }
+    a.release();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
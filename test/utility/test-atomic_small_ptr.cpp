@@ -0,0 +1,93 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_atomic_small_ptr
+#include "utility/test/boost_unit_test.hpp"
+
+#include <memory>
+
+#include "utility/atomic_small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_atomic_small_ptr)
+
+struct object : utility::shared {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+typedef utility::small_ptr <object> pointer_type;
+typedef utility::atomic_small_ptr <object> atomic_pointer_type;
+
+BOOST_AUTO_TEST_CASE (test_utility_atomic_small_ptr_basic) {
+    utility::tracked_registry registry;
+    std::allocator <object> allocator;
+    {
+        atomic_pointer_type empty;
+        BOOST_CHECK (empty.is_lock_free());
+        BOOST_CHECK (!empty.load());
+
+        pointer_type p1 = pointer_type::construct (allocator, registry, 1);
+        atomic_pointer_type a (p1);
+        BOOST_CHECK_EQUAL (p1.use_count(), 2);
+        {
+            pointer_type loaded = a.load();
+            BOOST_CHECK (loaded == p1);
+            BOOST_CHECK_EQUAL (p1.use_count(), 3);
+        }
+        BOOST_CHECK_EQUAL (p1.use_count(), 2);
+
+        pointer_type p2 = pointer_type::construct (allocator, registry, 2);
+        pointer_type old = a.exchange (p2);
+        BOOST_CHECK (old == p1);
+        BOOST_CHECK (a.load() == p2);
+        BOOST_CHECK_EQUAL (p2.use_count(), 2);
+
+        // The reference that "a" held to p1 may still be retired.
+        atomic_pointer_type::reclaim();
+        BOOST_CHECK_EQUAL (p1.use_count(), 2);
+        old = pointer_type (allocator);
+        BOOST_CHECK (p1.unique());
+
+        // compare_exchange.
+        pointer_type expected = p1;
+        BOOST_CHECK (!a.compare_exchange_strong (expected, p1));
+        BOOST_CHECK (expected == p2);
+        BOOST_CHECK (p1.unique());
+        BOOST_CHECK (a.compare_exchange_strong (expected, p1));
+        BOOST_CHECK (a.load() == p1);
+        atomic_pointer_type::reclaim();
+        BOOST_CHECK_EQUAL (p2.use_count(), 2);
+
+        a.store (pointer_type (allocator));
+        BOOST_CHECK (!a.load());
+        atomic_pointer_type::reclaim();
+        BOOST_CHECK (p1.unique());
+
+        a.store (p1);
+        p1 = pointer_type (allocator);
+        p2 = pointer_type (allocator);
+        expected = pointer_type (allocator);
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+    }
+    // The destructor of "a" releases the last reference.
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Test biased_shared from one thread.
+The interaction between threads is tested in
+threaded/test-biased_shared-threaded.cpp.
+*/
+
+#define BOOST_TEST_MODULE test_utility_biased_shared
+#include "utility/test/boost_unit_test.hpp"
+
+#include <memory>
+
+#include "utility/biased_shared.hpp"
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_biased_shared)
+
+struct object : utility::biased_shared {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_biased_shared_small_ptr) {
+    typedef utility::small_ptr <object> pointer_type;
+    utility::tracked_registry registry;
+    {
+        std::allocator <object> allocator;
+        pointer_type p1 = pointer_type::construct (allocator, registry, 5);
+        BOOST_CHECK (p1.unique());
+        BOOST_CHECK_EQUAL (p1->value.content(), 5);
+
+        // Copying the object must not copy the count.
+        pointer_type p4 = pointer_type::construct (allocator, *p1);
+        BOOST_CHECK (p4.unique());
+        BOOST_CHECK_EQUAL (p4->value.content(), 5);
+        *p4 = *p1;
+        BOOST_CHECK (p4.unique());
+        BOOST_CHECK (p1.unique());
+        {
+            pointer_type p2 = p1;
+            BOOST_CHECK_EQUAL (p1.use_count(), 2);
+            pointer_type p3 (allocator);
+            p3 = p2;
+            BOOST_CHECK_EQUAL (p1.use_count(), 3);
+        }
+        BOOST_CHECK (p1.unique());
+        BOOST_CHECK_EQUAL (registry.value_construct_count(), 1);
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+    }
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
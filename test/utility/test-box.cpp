@@ -0,0 +1,96 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_box
+#include "utility/test/boost_unit_test.hpp"
+
+#include <string>
+#include <utility>
+
+#include "utility/box.hpp"
+
+#include "utility/test/tracked.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_box)
+
+struct point {
+    int x;
+    int y;
+    point (int x, int y) : x (x), y (y) {}
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_box_basic) {
+    static_assert (sizeof (utility::box <point>) <= sizeof (point) + 4, "");
+
+    utility::box <point> empty;
+    BOOST_CHECK (!empty);
+    BOOST_CHECK (empty.get() == nullptr);
+
+    auto b = utility::box <point>::construct (3, 4);
+    BOOST_CHECK (b);
+    BOOST_CHECK_EQUAL (b->x, 3);
+    BOOST_CHECK_EQUAL ((*b).y, 4);
+    // The object is inside the box.
+    BOOST_CHECK (static_cast <void *> (b.get()) == static_cast <void *> (&b));
+
+    // Copies have their own object.
+    auto c = b;
+    c->x = 7;
+    BOOST_CHECK_EQUAL (b->x, 3);
+    BOOST_CHECK_EQUAL (c->x, 7);
+    BOOST_CHECK (b != c);
+    BOOST_CHECK (empty == utility::box <point>());
+
+    // A const box gives mutable access, like a pointer.
+    utility::box <point> const & const_b = b;
+    const_b->y = 5;
+    BOOST_CHECK_EQUAL (b->y, 5);
+
+    // Moving makes the source empty.
+    auto d = std::move (c);
+    BOOST_CHECK (!c);
+    BOOST_CHECK_EQUAL (d->x, 7);
+
+    swap (b, d);
+    BOOST_CHECK_EQUAL (b->x, 7);
+    BOOST_CHECK_EQUAL (d->x, 3);
+    BOOST_CHECK_EQUAL (d->y, 5);
+
+    swap (b, empty);
+    BOOST_CHECK (!b);
+    BOOST_CHECK_EQUAL (empty->x, 7);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_box_lifetime) {
+    utility::tracked_registry registry;
+    typedef utility::box <utility::tracked <std::string>> box_type;
+    {
+        auto b = box_type::construct (registry, "hello");
+        BOOST_CHECK_EQUAL (b->content(), "hello");
+        box_type c (b);
+        BOOST_CHECK_EQUAL (c->content(), "hello");
+        box_type d;
+        d = std::move (c);
+        BOOST_CHECK (!c);
+        d = b;
+        BOOST_CHECK_EQUAL (d->content(), "hello");
+        BOOST_CHECK_EQUAL (registry.value_construct_count(), 1);
+    }
+    // All objects that were constructed have been destructed.
+    BOOST_CHECK_EQUAL (registry.alive_count(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,152 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_compact_ptr
+#include "utility/test/boost_unit_test.hpp"
+
+#include <cstdint>
+#include <memory>
+
+#include "utility/compact_region.hpp"
+#include "utility/compact_shared.hpp"
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+struct test_region_tag;
+typedef utility::compact_region <test_region_tag> test_region;
+
+struct object : utility::compact_shared <std::uint32_t> {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+typedef utility::compact_ptr <object, test_region> object_ptr;
+
+/* Nodes of a list. */
+
+struct node;
+
+typedef utility::compact_ptr <node, test_region> node_ptr;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <node> {
+        node_ptr && operator() (node * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+/// Node with a 32-bit count and a 32-bit pointer.
+struct node : utility::compact_shared <std::uint32_t> {
+    int value_;
+    node_ptr next_;
+
+    explicit node (int value) : value_ (value) {}
+};
+
+inline node_ptr &&
+    utility::pointer_policy::move_recursive_next <node>::operator() (
+        node * object) const
+{ return std::move (object->next_); }
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_compact_ptr)
+
+BOOST_AUTO_TEST_CASE (test_utility_compact_ptr_basic) {
+    static_assert (sizeof (object_ptr) == 4, "");
+
+    test_region::initialize (1 << 20);
+    utility::tracked_registry registry;
+    {
+        object_ptr empty;
+        BOOST_CHECK (!empty);
+        BOOST_CHECK (empty.get() == nullptr);
+
+        object_ptr p = object_ptr::construct (registry, 5);
+        BOOST_CHECK (p);
+        BOOST_CHECK_EQUAL (p->value.content(), 5);
+        BOOST_CHECK_EQUAL (reinterpret_cast <std::uintptr_t> (p.get())
+            % test_region::granularity, 0u);
+        object * address = p.get();
+        {
+            object_ptr q = p;
+            BOOST_CHECK (q == p);
+            BOOST_CHECK_EQUAL (p.use_count(), 2);
+            empty = q;
+        }
+        BOOST_CHECK_EQUAL (p.use_count(), 2);
+        empty = object_ptr();
+        BOOST_CHECK (p.unique());
+
+        object_ptr other = object_ptr::construct (registry, 6);
+        BOOST_CHECK (other != p);
+        swap (other, p);
+        BOOST_CHECK_EQUAL (p->value.content(), 6);
+
+        // Memory is reused.
+        p = object_ptr();
+        other = object_ptr();
+        BOOST_CHECK_EQUAL (registry.alive_count(), 0);
+        object_ptr reused = object_ptr::construct (registry, 7);
+        BOOST_CHECK (reused.get() == address);
+    }
+    BOOST_CHECK_EQUAL (registry.alive_count(), 0);
+
+    // The allocator puts objects for small_ptr in the region.
+    {
+        typedef utility::compact_region_allocator <int, test_region_tag>
+            allocator_type;
+        allocator_type allocator;
+        int * i = allocator.allocate (1);
+        BOOST_CHECK (reinterpret_cast <char *> (i) > test_region::base());
+        allocator.deallocate (i, 1);
+    }
+    test_region::release();
+}
+
+static constexpr int node_num = 1000;
+
+/**
+Each node takes one block of the region.
+The benchmark for traversing lists of these is in
+threaded/benchmark-compact_ptr.cpp.
+*/
+BOOST_AUTO_TEST_CASE (test_utility_compact_ptr_list) {
+    static_assert (sizeof (node_ptr) == 4, "");
+    test_region::initialize (
+        std::size_t (node_num + 1) * test_region::granularity);
+    {
+        node_ptr list;
+        for (int i = 0; i != node_num; ++ i) {
+            node_ptr first = node_ptr::construct (i);
+            first->next_ = std::move (list);
+            list = std::move (first);
+        }
+        BOOST_CHECK (test_region::used()
+            <= std::size_t (node_num + 1) * test_region::granularity);
+
+        long sum = 0;
+        for (auto current = list.get(); current;
+                current = current->next_.get())
+            sum += current->value_;
+        BOOST_CHECK_EQUAL (sum, long (node_num) * (node_num - 1) / 2);
+    }
+    test_region::release();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
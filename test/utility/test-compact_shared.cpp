@@ -0,0 +1,123 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_compact_shared
+#include "utility/test/boost_unit_test.hpp"
+
+#include <cstdint>
+#include <memory>
+
+#include "utility/compact_shared.hpp"
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_compact_shared)
+
+struct shared32 : utility::compact_shared <std::uint32_t> {};
+
+struct tagged16 : utility::compact_shared <std::uint16_t, 4> {
+    typedef utility::compact_shared <std::uint16_t, 4> base_type;
+    explicit tagged16 (std::uint16_t tag) : base_type (tag) {}
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_compact_shared_basic) {
+    static_assert (sizeof (shared32) == 4, "");
+    static_assert (sizeof (tagged16) == 2, "");
+
+    shared32 s;
+    BOOST_CHECK_EQUAL (shared32::get_count (&s), 0);
+    shared32::acquire (&s);
+    shared32::acquire (&s);
+    BOOST_CHECK_EQUAL (shared32::get_count (&s), 2);
+    BOOST_CHECK (!shared32::release_count (&s));
+    BOOST_CHECK (shared32::release_count (&s));
+    BOOST_CHECK_EQUAL (shared32::get_count (&s), 0);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_compact_shared_tag) {
+    tagged16 s (5);
+    BOOST_CHECK_EQUAL (tagged16::get_tag (&s), 5);
+    tagged16::acquire (&s);
+    tagged16::acquire (&s);
+    BOOST_CHECK_EQUAL (tagged16::get_count (&s), 2);
+    BOOST_CHECK_EQUAL (tagged16::get_tag (&s), 5);
+
+    tagged16::set_tag (&s, 11);
+    BOOST_CHECK_EQUAL (tagged16::get_tag (&s), 11);
+    BOOST_CHECK_EQUAL (tagged16::get_count (&s), 2);
+    // Only the lowest bits are used.
+    tagged16::set_tag (&s, 0x13);
+    BOOST_CHECK_EQUAL (tagged16::get_tag (&s), 3);
+
+    // Copies get the tag, but not the count.
+    tagged16 copy (s);
+    BOOST_CHECK_EQUAL (tagged16::get_tag (&copy), 3);
+    BOOST_CHECK_EQUAL (tagged16::get_count (&copy), 0);
+
+    BOOST_CHECK (!tagged16::release_count (&s));
+    BOOST_CHECK (tagged16::release_count (&s));
+    BOOST_CHECK_EQUAL (tagged16::get_tag (&s), 3);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_compact_shared_saturate) {
+    // 4 bits for the count.
+    struct tiny : utility::compact_shared <std::uint8_t, 4> {};
+    BOOST_CHECK_EQUAL (tiny::max_count, 15);
+
+    tiny s;
+    for (int i = 0; i != 8; ++ i) {
+        BOOST_CHECK (!tiny::is_saturated (&s));
+        tiny::acquire (&s);
+    }
+    // Half the range has been reached.
+    BOOST_CHECK (tiny::is_saturated (&s));
+    long count = tiny::get_count (&s);
+    BOOST_CHECK_EQUAL (count, tiny::saturated_count);
+
+    // Now the count does not change any more.
+    for (int i = 0; i != 100; ++ i)
+        tiny::acquire (&s);
+    for (int i = 0; i != 200; ++ i)
+        BOOST_CHECK (!tiny::release_count (&s));
+    BOOST_CHECK_EQUAL (tiny::get_count (&s), count);
+}
+
+struct object : utility::compact_shared <std::uint32_t> {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_compact_shared_small_ptr) {
+    typedef utility::small_ptr <object> pointer_type;
+    utility::tracked_registry registry;
+    {
+        std::allocator <object> allocator;
+        pointer_type p1 = pointer_type::construct (allocator, registry, 5);
+        BOOST_CHECK (p1.unique());
+        {
+            pointer_type p2 = p1;
+            BOOST_CHECK_EQUAL (p1.use_count(), 2);
+        }
+        BOOST_CHECK (p1.unique());
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+    }
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,145 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_counted_small_ptr
+#include "utility/test/boost_unit_test.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/test_allocator.hpp"
+#include "utility/test/throwing.hpp"
+#include "utility/test/tracked.hpp"
+
+struct node;
+
+typedef utility::counted_small_ptr <node> node_ptr;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <node> {
+        node_ptr && operator() (node * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+struct node {
+    int value_;
+    node_ptr next_;
+
+    explicit node (int value)
+    : value_ (value), next_ (std::allocator <node>()) {}
+};
+
+inline node_ptr &&
+    utility::pointer_policy::move_recursive_next <node>::operator() (
+        node * object) const
+{ return std::move (object->next_); }
+
+/// Type that needs more alignment than the count.
+struct alignas (32) aligned {
+    char c;
+};
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_counted_small_ptr)
+
+BOOST_AUTO_TEST_CASE (test_utility_counted_small_ptr_basic) {
+    typedef utility::counted_small_ptr <std::string> string_ptr;
+    static_assert (sizeof (string_ptr) == sizeof (void *), "");
+
+    std::allocator <std::string> allocator;
+    string_ptr empty (allocator);
+    BOOST_CHECK (!empty);
+    BOOST_CHECK_EQUAL (empty.use_count(), 0);
+
+    string_ptr s = string_ptr::construct (allocator, "Hello");
+    BOOST_CHECK_EQUAL (*s, "Hello");
+    BOOST_CHECK_EQUAL (s->size(), 5u);
+    BOOST_CHECK (s.unique());
+    {
+        string_ptr s2 = s;
+        BOOST_CHECK (s2 == s);
+        BOOST_CHECK_EQUAL (s.use_count(), 2);
+        *s2 += ", world";
+        empty = s2;
+        BOOST_CHECK_EQUAL (s.use_count(), 3);
+    }
+    BOOST_CHECK_EQUAL (*s, "Hello, world");
+    BOOST_CHECK_EQUAL (s.use_count(), 2);
+
+    typedef utility::counted_small_ptr <int> int_ptr;
+    std::allocator <int> int_allocator;
+    int_ptr i = int_ptr::construct (int_allocator, 5);
+    BOOST_CHECK_EQUAL (*i, 5);
+
+    typedef utility::counted_small_ptr <aligned> aligned_ptr;
+    std::allocator <aligned> aligned_allocator;
+    aligned_ptr a = aligned_ptr::construct (aligned_allocator);
+    BOOST_CHECK_EQUAL (reinterpret_cast <std::uintptr_t> (a.get()) % 32, 0u);
+}
+
+/**
+Check that each object takes one allocation, that everything is destructed
+and deallocated, and that exceptions from the constructor are handled.
+*/
+void check_counted_small_ptr (utility::thrower & thrower) {
+    typedef utility::test_allocator <std::allocator <
+        utility::throwing <utility::tracked <int>>>> allocator_type;
+    typedef utility::counted_small_ptr <
+        utility::throwing <utility::tracked <int>>, allocator_type>
+        pointer_type;
+
+    utility::tracked_registry registry;
+    {
+        allocator_type allocator (thrower);
+        pointer_type p = pointer_type::construct (allocator,
+            thrower, utility::tracked <int> (registry, 4));
+        BOOST_CHECK_EQUAL (allocator.allocation_count(), 1u);
+        pointer_type q = p;
+        BOOST_CHECK_EQUAL (q->content().content(), 4);
+        p = pointer_type::construct (allocator,
+            thrower, utility::tracked <int> (registry, 5));
+        BOOST_CHECK_EQUAL (allocator.allocation_count(), 2u);
+        q = p;
+        BOOST_CHECK_EQUAL (registry.alive_count(), 1);
+    }
+    BOOST_CHECK_EQUAL (registry.alive_count(), 0);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_counted_small_ptr_exception) {
+    utility::check_all_throw_points (check_counted_small_ptr);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_counted_small_ptr_list) {
+    std::allocator <node> allocator;
+    node_ptr first (allocator);
+    node_ptr * current = &first;
+    for (int i = 0; i != 1000000; ++ i) {
+        *current = node_ptr::construct (allocator, i);
+        current = &(*current)->next_;
+    }
+    node_ptr second = first->next_;
+    BOOST_CHECK_EQUAL (second.use_count(), 2);
+    // Destruction is iterative.
+    first = node_ptr (allocator);
+    BOOST_CHECK (second.unique());
+    BOOST_CHECK_EQUAL (second->value_, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_cow_ptr
+#include "utility/test/boost_unit_test.hpp"
+
+#include <type_traits>
+
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/test_allocator.hpp"
+#include "utility/test/tracked.hpp"
+
+struct object : utility::shared {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_cow_ptr)
+
+BOOST_AUTO_TEST_CASE (test_utility_cow_ptr) {
+    typedef utility::test_allocator <std::allocator <object>> allocator_type;
+    typedef utility::cow_ptr <object, allocator_type> pointer_type;
+
+    static_assert (std::is_same <decltype (std::declval <pointer_type &>()
+        .operator->()), object const *>::value, "");
+
+    utility::thrower thrower;
+    utility::tracked_registry registry;
+    allocator_type allocator (thrower);
+    {
+        pointer_type p = pointer_type::construct (allocator, registry, 5);
+        BOOST_CHECK_EQUAL (allocator.allocation_count(), 1u);
+        object const * original = p.get();
+
+        // Writing while unique does not copy.
+        p.write().value = utility::tracked <int> (registry, 6);
+        BOOST_CHECK (p.get() == original);
+        BOOST_CHECK_EQUAL (p->value.content(), 6);
+        BOOST_CHECK_EQUAL (allocator.allocation_count(), 1u);
+
+        // Copies share the object.
+        pointer_type q = p;
+        BOOST_CHECK (q.get() == original);
+        BOOST_CHECK_EQUAL (p.use_count(), 2);
+        BOOST_CHECK_EQUAL ((*q).value.content(), 6);
+
+        // Writing to a shared object copies it.
+        q.write().value = utility::tracked <int> (registry, 7);
+        BOOST_CHECK (q.get() != original);
+        BOOST_CHECK (p.get() == original);
+        BOOST_CHECK (p.unique());
+        BOOST_CHECK (q.unique());
+        BOOST_CHECK_EQUAL (p->value.content(), 6);
+        BOOST_CHECK_EQUAL (q->value.content(), 7);
+        BOOST_CHECK_EQUAL (allocator.allocation_count(), 2u);
+        BOOST_CHECK (q.allocator() == p.allocator());
+
+        // Now both are unique, so writing does not copy.
+        object const * copy = q.get();
+        q.write().value = utility::tracked <int> (registry, 8);
+        BOOST_CHECK (q.get() == copy);
+        BOOST_CHECK_EQUAL (allocator.allocation_count(), 2u);
+        BOOST_CHECK_EQUAL (registry.alive_count(), 2);
+
+        // If copying throws, the pointer is unchanged.
+        pointer_type r = p;
+        thrower.reset();
+        thrower.set_cycle (1);
+        BOOST_CHECK_THROW (r.write(), utility::thrower_exception);
+        thrower.set_cycle (-1);
+        BOOST_CHECK (r.get() == original);
+        BOOST_CHECK_EQUAL (p.use_count(), 2);
+        BOOST_CHECK_EQUAL (registry.alive_count(), 2);
+    }
+    BOOST_CHECK_EQUAL (registry.alive_count(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,146 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_deferred_release
+#include "utility/test/boost_unit_test.hpp"
+
+#include <memory>
+#include <vector>
+
+#include "utility/deferred_release.hpp"
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+struct object : utility::shared {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+struct node;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <node> {
+        utility::deferred_small_ptr <node> &&
+            operator() (node * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+struct node : utility::shared {
+    int value_;
+    utility::deferred_small_ptr <node> next_;
+
+    node (int value)
+    : value_ (value), next_ (std::allocator <node>()) {}
+};
+
+inline utility::deferred_small_ptr <node> &&
+    utility::pointer_policy::move_recursive_next <node>::operator() (
+        node * object) const
+{ return std::move (object->next_); }
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_deferred_release)
+
+using utility::pointer_policy::flush_deferred_releases;
+
+typedef utility::deferred_small_ptr <object> pointer_type;
+
+BOOST_AUTO_TEST_CASE (test_utility_deferred_release_basic) {
+    utility::tracked_registry registry;
+    std::allocator <object> allocator;
+    {
+        pointer_type p1 = pointer_type::construct (allocator, registry, 5);
+        BOOST_CHECK (p1.unique());
+        object * o = p1.get();
+        {
+            pointer_type p2 = p1;
+            BOOST_CHECK_EQUAL (p1.use_count(), 2);
+        }
+        // The release is pending.
+        BOOST_CHECK (p1.unique());
+        BOOST_CHECK_EQUAL (utility::shared::get_count (o), 2);
+
+        // This cancels the pending release.
+        {
+            pointer_type p2 = p1;
+            BOOST_CHECK_EQUAL (utility::shared::get_count (o), 2);
+            BOOST_CHECK_EQUAL (p1.use_count(), 2);
+        }
+        BOOST_CHECK_EQUAL (utility::shared::get_count (o), 2);
+
+        // Coalesce releases.
+        {
+            std::vector <pointer_type> copies (10, p1);
+            BOOST_CHECK_EQUAL (p1.use_count(), 11);
+        }
+        BOOST_CHECK (p1.unique());
+        BOOST_CHECK_EQUAL (utility::shared::get_count (o), 11);
+
+        flush_deferred_releases();
+        BOOST_CHECK (p1.unique());
+        BOOST_CHECK_EQUAL (utility::shared::get_count (o), 1);
+    }
+    // The object is kept alive until the releases are flushed.
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+    flush_deferred_releases();
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+
+    // Flushing an empty buffer does nothing.
+    flush_deferred_releases();
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_deferred_release_many) {
+    // More objects than the buffer has slots, so that slots are evicted.
+    utility::tracked_registry registry;
+    std::allocator <object> allocator;
+    {
+        std::vector <pointer_type> pointers;
+        for (int i = 0; i != 1000; ++ i)
+            pointers.push_back (
+                pointer_type::construct (allocator, registry, i));
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+    }
+    BOOST_CHECK (registry.destruct_count() > 0);
+    BOOST_CHECK (registry.destruct_count() < 1000);
+    flush_deferred_releases();
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1000);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_deferred_release_list) {
+    // Destruct a long list when the releases are flushed.
+    // This should happen iteratively and not overflow the stack.
+    typedef utility::deferred_small_ptr <node> node_pointer;
+    std::allocator <node> allocator;
+    {
+        node_pointer first (allocator);
+        node_pointer * current = &first;
+        for (int i = 0; i != 500000; ++ i) {
+            *current = node_pointer::construct (allocator, i);
+            current = &(*current)->next_;
+        }
+        flush_deferred_releases();
+        BOOST_CHECK (first.unique());
+        BOOST_CHECK_EQUAL (first->next_->value_, 1);
+    }
+    flush_deferred_releases();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
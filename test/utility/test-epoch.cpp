@@ -0,0 +1,102 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_epoch
+#include "utility/test/boost_unit_test.hpp"
+
+#include <memory>
+
+#include "utility/epoch.hpp"
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_epoch)
+
+struct object {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+typedef utility::epoch_ptr <object> pointer_type;
+
+/**
+Collect until all retired objects have been destructed.
+This is only possible if no thread is pinned.
+*/
+void collect_all() {
+    // Two advances of the epoch are needed.
+    for (int i = 0; i != 3; ++ i)
+        utility::epoch::collect();
+    BOOST_CHECK_EQUAL (utility::epoch::retired_count(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_epoch_basic) {
+    utility::tracked_registry registry;
+    std::allocator <object> allocator;
+
+    pointer_type p = pointer_type::construct (allocator, registry, 5);
+    {
+        // Copies do not own the object.
+        pointer_type copy = p;
+        BOOST_CHECK (copy == p);
+        BOOST_CHECK_EQUAL (copy->value.content(), 5);
+    }
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+
+    {
+        utility::epoch::guard guard;
+        pointer_type reader = p;
+        p.retire();
+        BOOST_CHECK (!p);
+        BOOST_CHECK_EQUAL (utility::epoch::retired_count(), 1u);
+
+        // This thread is pinned, so the object stays alive.
+        utility::epoch::collect();
+        utility::epoch::collect();
+        utility::epoch::collect();
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+        BOOST_CHECK_EQUAL (reader->value.content(), 5);
+
+        // Nested guards.
+        {
+            utility::epoch::guard inner;
+        }
+        utility::epoch::collect();
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+    }
+    collect_all();
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+
+    // Retiring an empty pointer does nothing.
+    p.retire();
+    BOOST_CHECK_EQUAL (utility::epoch::retired_count(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_epoch_many) {
+    utility::tracked_registry registry;
+    std::allocator <object> allocator;
+    for (int i = 0; i != 1000; ++ i)
+        pointer_type::construct (allocator, registry, i).retire();
+    // Objects are collected in batches.
+    BOOST_CHECK (registry.destruct_count() > 0);
+    collect_all();
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,139 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_incremental_destruction
+#include "utility/test/boost_unit_test.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include "utility/small_ptr.hpp"
+#include "utility/incremental_destruction.hpp"
+
+static constexpr std::size_t budget = 100;
+
+int destruct_count = 0;
+
+struct node;
+
+typedef utility::small_ptr <node> node_ptr;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <node> {
+        typedef destruct_chain_incrementally <budget> destruction;
+        node_ptr && operator() (node * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+struct node : utility::shared {
+    int value_;
+    node_ptr next_;
+
+    explicit node (int value)
+    : value_ (value), next_ (std::allocator <node>()) {}
+
+    ~node() { ++ destruct_count; }
+};
+
+inline node_ptr &&
+    utility::pointer_policy::move_recursive_next <node>::operator() (
+        node * object) const
+{ return std::move (object->next_); }
+
+node_ptr make_list (int length) {
+    std::allocator <node> allocator;
+    node_ptr first (allocator);
+    for (int i = length - 1; i >= 0; -- i) {
+        node_ptr n = node_ptr::construct (allocator, i);
+        n->next_ = std::move (first);
+        first = std::move (n);
+    }
+    return first;
+}
+
+using utility::incremental_destruction::collect;
+using utility::incremental_destruction::collect_all;
+using utility::incremental_destruction::parked_count;
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_incremental_destruction)
+
+BOOST_AUTO_TEST_CASE (test_incremental_destruction) {
+    destruct_count = 0;
+    node_ptr list = make_list (1000);
+    list = node_ptr (std::allocator <node>());
+    // The first node, and the budget after it.
+    BOOST_CHECK_EQUAL (destruct_count, int (budget) + 1);
+    BOOST_CHECK_EQUAL (parked_count(), 1u);
+
+    // A short list leaves some budget, which is used for the parked chain.
+    list = make_list (10);
+    list = node_ptr (std::allocator <node>());
+    BOOST_CHECK_EQUAL (destruct_count,
+        int (budget) + 1 + 10 + int (budget) - 9);
+    BOOST_CHECK_EQUAL (parked_count(), 1u);
+
+    collect (50);
+    BOOST_CHECK_EQUAL (destruct_count, 2 * int (budget) + 52);
+
+    collect_all();
+    BOOST_CHECK_EQUAL (destruct_count, 1010);
+    BOOST_CHECK_EQUAL (parked_count(), 0u);
+
+    // A chain stops at a shared node.
+    destruct_count = 0;
+    list = make_list (1000);
+    node_ptr tail = list;
+    for (int i = 0; i != 500; ++ i)
+        tail = tail->next_;
+    list = node_ptr (std::allocator <node>());
+    collect_all();
+    BOOST_CHECK_EQUAL (destruct_count, 500);
+    BOOST_CHECK_EQUAL (tail->value_, 500);
+    BOOST_CHECK (tail.unique());
+    tail = node_ptr (std::allocator <node>());
+    collect_all();
+    BOOST_CHECK_EQUAL (destruct_count, 1000);
+}
+
+BOOST_AUTO_TEST_CASE (test_incremental_destruction_long) {
+    static constexpr int node_num = 500000;
+    destruct_count = 0;
+    node_ptr list = make_list (node_num);
+
+    auto start = std::chrono::steady_clock::now();
+    list = node_ptr (std::allocator <node>());
+    auto end = std::chrono::steady_clock::now();
+    BOOST_CHECK_EQUAL (destruct_count, int (budget) + 1);
+
+    std::size_t collect_num = 0;
+    while (parked_count() != 0) {
+        collect (budget);
+        ++ collect_num;
+    }
+    BOOST_CHECK_EQUAL (destruct_count, node_num);
+    BOOST_CHECK_EQUAL (collect_num,
+        (node_num - budget - 1 + budget - 1) / budget);
+
+    std::cout << "Releasing a list of " << node_num
+        << " nodes with a budget of " << budget << ": "
+        << std::chrono::duration <double, std::micro> (end - start).count()
+        << " us." << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
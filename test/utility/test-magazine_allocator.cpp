@@ -0,0 +1,94 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_magazine_allocator
+#include "utility/test/boost_unit_test.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <set>
+
+#include "utility/magazine_allocator.hpp"
+#include "utility/small_ptr.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_magazine_allocator)
+
+struct object : utility::shared {
+    int value;
+    explicit object (int value) : value (value) {}
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_magazine_allocator_small_ptr) {
+    typedef utility::magazine_allocator <object> allocator_type;
+    typedef utility::small_ptr <object, allocator_type> pointer_type;
+    static_assert (sizeof (pointer_type) == sizeof (void *), "");
+
+    allocator_type allocator;
+    BOOST_CHECK (allocator == utility::magazine_allocator <int>());
+
+    object * address;
+    {
+        pointer_type p = pointer_type::construct (allocator, 4);
+        address = p.get();
+        BOOST_CHECK_EQUAL (p->value, 4);
+    }
+    // Blocks that the thread deallocates are reused straight away.
+    pointer_type p = pointer_type::construct (allocator, 5);
+    BOOST_CHECK_EQUAL (p.get(), address);
+
+    std::vector <int, utility::magazine_allocator <int>> v (1000, 3);
+    BOOST_CHECK_EQUAL (v [999], 3);
+}
+
+/**
+Simulate two threads with two heaps.
+*/
+BOOST_AUTO_TEST_CASE (test_utility_magazine_allocator_remote) {
+    using namespace utility::magazine_allocator_detail;
+    heap producer (32);
+    heap consumer (32);
+
+    // Fill exactly two slabs.
+    std::size_t block_num = 2 * ((slab_size - slab_header_size) / 32);
+    std::vector <void *> blocks;
+    for (std::size_t i = 0; i != block_num; ++ i) {
+        void * block = producer.allocate();
+        BOOST_CHECK_EQUAL (
+            reinterpret_cast <std::uintptr_t> (block) % alignment, 0u);
+        BOOST_CHECK_EQUAL (owner_of (block), &producer);
+        blocks.push_back (block);
+    }
+    std::set <void *> unique (blocks.begin(), blocks.end());
+    BOOST_CHECK_EQUAL (unique.size(), blocks.size());
+
+    // The consumer sends the blocks back.
+    for (void * block : blocks)
+        consumer.deallocate (block);
+    consumer.flush();
+
+    // The producer reuses them before it allocates a new slab.
+    std::set <void *> reused;
+    for (std::size_t i = 0; i != block_num; ++ i)
+        reused.insert (producer.allocate());
+    BOOST_CHECK (reused == unique);
+
+    // Blocks that a heap owns do not go through the remote list.
+    void * own = consumer.allocate();
+    consumer.deallocate (own);
+    BOOST_CHECK_EQUAL (consumer.allocate(), own);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
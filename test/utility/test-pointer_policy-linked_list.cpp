@@ -28,7 +28,9 @@ This file tries to cause a stack overflow.
 #include "utility/test/boost_unit_test.hpp"
 
 #include "utility/small_ptr.hpp"
+#include "utility/pool_allocator.hpp"
 
+#include <cstdint>
 #include <memory>
 #include <iostream>
 
@@ -53,6 +55,13 @@ template <bool DestructWithLoop> struct node : utility::shared {
     : value_ (value), next_ (std::allocator <node>()) {}
 };
 
+struct local_node;
+struct compact_node;
+struct pool_node;
+
+typedef utility::small_ptr <pool_node, utility::pool_allocator <pool_node>>
+    pool_node_ptr;
+
 // Supply access to the pointer to the next element.
 namespace utility { namespace pointer_policy {
 
@@ -62,16 +71,77 @@ namespace utility { namespace pointer_policy {
         { return std::move (object->next_); }
     };
 
+    // This must be specialised before local_node is defined, because that
+    // instantiates local_small_ptr <local_node>.
+    template <> struct move_recursive_next <local_node> {
+        utility::local_small_ptr <local_node> &&
+            operator() (local_node * object) const;
+    };
+
+    template <> struct move_recursive_next <compact_node> {
+        utility::small_ptr <compact_node> &&
+            operator() (compact_node * object) const;
+    };
+
+    template <> struct move_recursive_next <pool_node> {
+        pool_node_ptr && operator() (pool_node * object) const;
+    };
+
 }} // namespace utility::pointer_policy
 
+/**
+Node for a linked list that is confined to one thread.
+*/
+struct local_node : utility::local_shared {
+    int value_;
+    utility::local_small_ptr <local_node> next_;
+
+    local_node (int value)
+    : value_ (value), next_ (std::allocator <local_node>()) {}
+};
+
+inline utility::local_small_ptr <local_node> &&
+    utility::pointer_policy::move_recursive_next <local_node>::operator() (
+        local_node * object) const
+{ return std::move (object->next_); }
+
+/**
+Node for a linked list with a 32-bit reference count.
+*/
+struct compact_node : utility::compact_shared <std::uint32_t> {
+    int value_;
+    utility::small_ptr <compact_node> next_;
+
+    compact_node (int value)
+    : value_ (value), next_ (std::allocator <compact_node>()) {}
+};
+
+inline utility::small_ptr <compact_node> &&
+    utility::pointer_policy::move_recursive_next <compact_node>::operator() (
+        compact_node * object) const
+{ return std::move (object->next_); }
+
+/**
+Node for a linked list that is allocated from a pool.
+*/
+struct pool_node : utility::shared {
+    int value_;
+    pool_node_ptr next_;
+
+    pool_node (int value)
+    : value_ (value), next_ (utility::pool_allocator <pool_node>()) {}
+};
+
+inline pool_node_ptr &&
+    utility::pointer_policy::move_recursive_next <pool_node>::operator() (
+        pool_node * object) const
+{ return std::move (object->next_); }
+
 BOOST_AUTO_TEST_SUITE (test_utility_pointer_policy_linked_list)
 
-template <bool DestructWithLoop> utility::small_ptr <node <DestructWithLoop>>
-    make_list (std::size_t number)
-{
-    typedef node <DestructWithLoop> node_type;
-    typedef utility::small_ptr <node <DestructWithLoop>> pointer_type;
-    std::allocator <node_type> allocator;
+template <class Pointer> Pointer make_list (std::size_t number) {
+    typedef Pointer pointer_type;
+    typename pointer_type::allocator_type allocator;
     pointer_type first (allocator);
     pointer_type * current = &first;
     for (std::size_t i = 0; i != number; ++ i) {
@@ -81,9 +151,9 @@ template <bool DestructWithLoop> utility::small_ptr <node <DestructWithLoop>>
     return first;
 }
 
-template <bool DestructWithLoop> void test_big_list() {
+template <class Pointer> void test_big_list() {
     std::cout << "Making list." << std::endl;
-    auto l = make_list <DestructWithLoop> (blow_up_stack_number);
+    auto l = make_list <Pointer> (blow_up_stack_number);
 
     std::cout << "Checking list." << std::endl;
     {
@@ -96,16 +166,41 @@ template <bool DestructWithLoop> void test_big_list() {
 
     BOOST_CHECK (l.unique());
     std::cout << "Destructing list." << std::endl;
-    l = make_list <DestructWithLoop> (0);
+    l = make_list <Pointer> (0);
     std::cout << "Done." << std::endl;
 }
 
 BOOST_AUTO_TEST_CASE (test_linked_list) {
     // This should not crash.
-    test_big_list <true>();
+    test_big_list <utility::small_ptr <node <true>>>();
 
     // This does cause a stack overflow.
-    // test_big_list <false>();
+    // test_big_list <utility::small_ptr <node <false>>>();
+}
+
+BOOST_AUTO_TEST_CASE (test_linked_list_local) {
+    // This should not crash either.
+    test_big_list <utility::local_small_ptr <local_node>>();
+}
+
+BOOST_AUTO_TEST_CASE (test_linked_list_compact) {
+    test_big_list <utility::small_ptr <compact_node>>();
+
+    // Report the memory that each node takes.
+    std::size_t size = sizeof (node <true>);
+    std::size_t compact_size = sizeof (compact_node);
+    std::cout << "Memory per node: " << size << " bytes with utility::shared; "
+        << compact_size << " bytes with utility::compact_shared <uint32_t>. "
+        << "For " << blow_up_stack_number << " nodes, this saves "
+        << (size - compact_size) * blow_up_stack_number << " bytes ("
+        << 100 * (size - compact_size) / size << "%)." << std::endl;
+    BOOST_CHECK (compact_size < size);
+}
+
+BOOST_AUTO_TEST_CASE (test_linked_list_pool) {
+    // threaded/benchmark-pool_allocator.cpp compares the speed with that of
+    // std::allocator.
+    test_big_list <pool_node_ptr>();
 }
 
 BOOST_AUTO_TEST_SUITE_END()
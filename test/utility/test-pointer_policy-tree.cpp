@@ -0,0 +1,197 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Like linked lists, trees can cause stack overflows when they are destructed
+recursively.
+pointer_policy::move_recursive_children makes destruction of nodes with more
+than one child iterative.
+
+This file tries to cause a stack overflow with degenerate trees.
+*/
+
+#define BOOST_TEST_MODULE test_utility_pointer_policy_tree
+#include "utility/test/boost_unit_test.hpp"
+
+#include <memory>
+
+#include "utility/small_ptr.hpp"
+
+static constexpr int blow_up_stack_number = 500000;
+
+int destruct_count = 0;
+
+/// Binary tree node.
+struct tree_node;
+/// Binary tree node with unique ownership.
+struct unique_tree_node;
+
+typedef utility::small_ptr <tree_node> tree_ptr;
+typedef utility::unique_small_ptr <unique_tree_node> unique_tree_ptr;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_children <tree_node> {
+        template <class Visitor>
+            void operator() (tree_node * object, Visitor && visit) const;
+    };
+
+    template <> struct move_recursive_children <unique_tree_node> {
+        template <class Visitor>
+            void operator() (unique_tree_node * object, Visitor && visit)
+            const;
+    };
+
+}} // namespace utility::pointer_policy
+
+struct tree_node : utility::shared {
+    int value_;
+    tree_ptr left_;
+    tree_ptr right_;
+
+    explicit tree_node (int value)
+    : value_ (value), left_ (std::allocator <tree_node>()),
+        right_ (std::allocator <tree_node>()) {}
+
+    ~tree_node() { ++ destruct_count; }
+};
+
+struct unique_tree_node {
+    unique_tree_ptr left_;
+    unique_tree_ptr right_;
+
+    unique_tree_node()
+    : left_ (std::allocator <unique_tree_node>()),
+        right_ (std::allocator <unique_tree_node>()) {}
+
+    ~unique_tree_node() { ++ destruct_count; }
+};
+
+template <class Visitor> inline void
+    utility::pointer_policy::move_recursive_children <tree_node>::operator() (
+        tree_node * object, Visitor && visit) const
+{
+    visit (std::move (object->left_));
+    visit (std::move (object->right_));
+}
+
+template <class Visitor> inline void utility::pointer_policy
+    ::move_recursive_children <unique_tree_node>::operator() (
+        unique_tree_node * object, Visitor && visit) const
+{
+    visit (std::move (object->left_));
+    visit (std::move (object->right_));
+}
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_pointer_policy_tree)
+
+tree_ptr leaf (int value) {
+    return tree_ptr::construct (std::allocator <tree_node>(), value);
+}
+
+BOOST_AUTO_TEST_CASE (test_tree_small) {
+    destruct_count = 0;
+    {
+        tree_ptr root = leaf (0);
+        root->left_ = leaf (1);
+        root->right_ = leaf (2);
+        root->left_->right_ = leaf (3);
+    }
+    BOOST_CHECK_EQUAL (destruct_count, 4);
+}
+
+/**
+Degenerate trees: each node has a deep left subtree and a leaf on the right,
+or the other way around.
+*/
+BOOST_AUTO_TEST_CASE (test_tree_deep) {
+    for (int direction = 0; direction != 2; ++ direction) {
+        destruct_count = 0;
+        {
+            tree_ptr root = leaf (0);
+            tree_node * current = root.get();
+            for (int i = 1; i != blow_up_stack_number; ++ i) {
+                tree_ptr & deep = direction ? current->left_ : current->right_;
+                tree_ptr & shallow
+                    = direction ? current->right_ : current->left_;
+                deep = leaf (i);
+                shallow = leaf (-i);
+                current = deep.get();
+            }
+        }
+        BOOST_CHECK_EQUAL (destruct_count, 2 * blow_up_stack_number - 1);
+    }
+}
+
+/**
+Directed acyclic graph: a deep spine whose nodes all point to one shared
+subtree.
+The shared subtree must be destructed only once, when the last reference to it
+goes away.
+*/
+BOOST_AUTO_TEST_CASE (test_tree_dag) {
+    destruct_count = 0;
+    tree_ptr shared = leaf (-1);
+    shared->left_ = leaf (-2);
+    {
+        tree_ptr root = leaf (0);
+        tree_node * current = root.get();
+        for (int i = 1; i != blow_up_stack_number; ++ i) {
+            current->right_ = shared;
+            current->left_ = leaf (i);
+            current = current->left_.get();
+        }
+        BOOST_CHECK_EQUAL (shared.use_count(), blow_up_stack_number);
+    }
+    BOOST_CHECK_EQUAL (destruct_count, blow_up_stack_number);
+    BOOST_CHECK (shared.unique());
+    BOOST_CHECK_EQUAL (shared->left_->value_, -2);
+
+    // A deep tree under a node that is shared is only destructed when the
+    // last reference goes away.
+    destruct_count = 0;
+    tree_ptr subtree = leaf (0);
+    {
+        tree_node * current = subtree.get();
+        for (int i = 1; i != blow_up_stack_number; ++ i) {
+            current->left_ = leaf (i);
+            current = current->left_.get();
+        }
+    }
+    shared->right_ = subtree;
+    shared = tree_ptr (std::allocator <tree_node>());
+    BOOST_CHECK_EQUAL (destruct_count, 2);
+    BOOST_CHECK (subtree.unique());
+    subtree = tree_ptr (std::allocator <tree_node>());
+    BOOST_CHECK_EQUAL (destruct_count, blow_up_stack_number + 2);
+}
+
+BOOST_AUTO_TEST_CASE (test_tree_unique) {
+    destruct_count = 0;
+    {
+        std::allocator <unique_tree_node> allocator;
+        unique_tree_ptr root = unique_tree_ptr::construct (allocator);
+        unique_tree_node * current = root.get();
+        for (int i = 1; i != blow_up_stack_number; ++ i) {
+            current->right_ = unique_tree_ptr::construct (allocator);
+            current->left_ = unique_tree_ptr::construct (allocator);
+            current = current->left_.get();
+        }
+    }
+    BOOST_CHECK_EQUAL (destruct_count, 2 * blow_up_stack_number - 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
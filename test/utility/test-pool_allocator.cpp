@@ -0,0 +1,120 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_pool_allocator
+#include "utility/test/boost_unit_test.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <set>
+#include <memory>
+
+#include "utility/pool_allocator.hpp"
+#include "utility/small_ptr.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_pool_allocator)
+
+BOOST_AUTO_TEST_CASE (test_utility_fixed_size_pool) {
+    utility::fixed_size_pool pool (20, 1024);
+    std::size_t alignment = utility::fixed_size_pool::alignment;
+    BOOST_CHECK_EQUAL (pool.block_size() % alignment, 0u);
+    BOOST_CHECK (pool.block_size() >= 20);
+
+    // Allocate more than fits in one slab.
+    std::vector <void *> blocks;
+    for (int i = 0; i != 200; ++ i) {
+        void * block = pool.allocate();
+        BOOST_CHECK_EQUAL (reinterpret_cast <std::uintptr_t> (block)
+            % alignment, 0u);
+        blocks.push_back (block);
+    }
+    std::set <void *> unique (blocks.begin(), blocks.end());
+    BOOST_CHECK_EQUAL (unique.size(), blocks.size());
+
+    // Deallocated blocks are reused.
+    pool.deallocate (blocks [17]);
+    BOOST_CHECK_EQUAL (pool.allocate(), blocks [17]);
+
+    for (void * block : blocks)
+        pool.deallocate (block);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_fixed_size_pool_splice) {
+    utility::fixed_size_pool pool (16, 256);
+    utility::fixed_size_pool other (16, 256);
+    BOOST_CHECK (pool.exhausted());
+
+    void * block = other.allocate();
+    void * free_block = other.allocate();
+    other.deallocate (free_block);
+    BOOST_CHECK (!other.exhausted());
+
+    pool.splice (other);
+    BOOST_CHECK (other.exhausted());
+    BOOST_CHECK (!pool.exhausted());
+    BOOST_CHECK_EQUAL (pool.allocate(), free_block);
+
+    // Blocks that were in use in "other" can be returned to "pool".
+    pool.deallocate (block);
+    pool.deallocate (free_block);
+}
+
+struct object : utility::shared {
+    int value;
+    explicit object (int value) : value (value) {}
+};
+
+struct big_object : utility::shared {
+    char data [1000];
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_pool_allocator_small_ptr) {
+    typedef utility::pool_allocator <object> allocator_type;
+    typedef utility::small_ptr <object, allocator_type> pointer_type;
+    // The allocator is stateless.
+    static_assert (sizeof (pointer_type) == sizeof (void *), "");
+
+    allocator_type allocator;
+    BOOST_CHECK (allocator == utility::pool_allocator <int>());
+
+    object * address;
+    {
+        pointer_type p = pointer_type::construct (allocator, 4);
+        pointer_type q = p;
+        BOOST_CHECK_EQUAL (q->value, 4);
+        address = p.get();
+    }
+    // The memory is reused for the next object of the same size.
+    pointer_type p = pointer_type::construct (allocator, 5);
+    BOOST_CHECK_EQUAL (p.get(), address);
+    BOOST_CHECK_EQUAL (p->value, 5);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_pool_allocator_unpooled) {
+    utility::pool_allocator <big_object> allocator;
+    big_object * o = allocator.allocate (1);
+    allocator.deallocate (o, 1);
+
+    utility::pool_allocator <int> int_allocator;
+    int * array = int_allocator.allocate (10);
+    array [9] = 3;
+    int_allocator.deallocate (array, 10);
+
+    std::vector <int, utility::pool_allocator <int>> v (100, 7);
+    BOOST_CHECK_EQUAL (v [99], 7);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
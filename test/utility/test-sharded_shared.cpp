@@ -0,0 +1,96 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_sharded_shared
+#include "utility/test/boost_unit_test.hpp"
+
+#include <memory>
+
+#include "utility/sharded_shared.hpp"
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_sharded_shared)
+
+struct sharded_shared : utility::sharded_shared {};
+
+BOOST_AUTO_TEST_CASE (test_utility_sharded_shared_basic) {
+    sharded_shared s;
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&s), 0);
+    sharded_shared::acquire (&s);
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&s), 1);
+    sharded_shared::acquire (&s);
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&s), 2);
+
+    // Copying must not copy the count.
+    sharded_shared copy (s);
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&copy), 0);
+    copy = s;
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&copy), 0);
+
+    // Before shutdown, the count is never reported as reaching zero.
+    BOOST_CHECK (!sharded_shared::release_count (&s));
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&s), 1);
+    sharded_shared::acquire (&s);
+
+    sharded_shared::shutdown (&s);
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&s), 2);
+    // Shutting down twice has no effect.
+    sharded_shared::shutdown (&s);
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&s), 2);
+
+    sharded_shared::acquire (&s);
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&s), 3);
+    BOOST_CHECK (!sharded_shared::release_count (&s));
+    BOOST_CHECK (!sharded_shared::release_count (&s));
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&s), 1);
+    BOOST_CHECK (sharded_shared::release_count (&s));
+    BOOST_CHECK_EQUAL (sharded_shared::get_count (&s), 0);
+}
+
+struct object : utility::sharded_shared {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_sharded_shared_small_ptr) {
+    typedef utility::small_ptr <object> pointer_type;
+    utility::tracked_registry registry;
+    {
+        std::allocator <object> allocator;
+        pointer_type p1 = pointer_type::construct (allocator, registry, 5);
+        BOOST_CHECK (p1.unique());
+        {
+            pointer_type p2 = p1;
+            BOOST_CHECK_EQUAL (p1.use_count(), 2);
+        }
+        BOOST_CHECK (p1.unique());
+
+        utility::sharded_shared::shutdown (p1.get());
+        BOOST_CHECK (p1.unique());
+        {
+            pointer_type p2 = p1;
+            BOOST_CHECK_EQUAL (p1.use_count(), 2);
+        }
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+    }
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -17,13 +17,16 @@ limitations under the License.
 #define BOOST_TEST_MODULE test_utility_shared
 #include "utility/test/boost_unit_test.hpp"
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "utility/test/test_allocator.hpp"
 #include "utility/test/throwing.hpp"
 #include "utility/test/tracked.hpp"
 
 #include "utility/shared.hpp"
+#include "utility/small_ptr.hpp"
 
 BOOST_AUTO_TEST_SUITE(test_suite_utility_shared)
 
@@ -43,6 +46,110 @@ BOOST_AUTO_TEST_CASE (test_utility_shared_basic) {
     BOOST_CHECK_EQUAL (shared::get_count (&s), 0);
 }
 
+/**
+Object that can be constructed as immortal at namespace scope.
+*/
+struct immortal_object : utility::shared {
+    int value;
+
+    explicit immortal_object (int value) : value (value) {}
+
+    constexpr immortal_object (utility::shared::immortal_tag tag, int value)
+    : utility::shared (tag), value (value) {}
+};
+
+// This is constant-initialised.
+immortal_object global_immortal {utility::shared::immortal_tag(), 27};
+
+// Check that the constructor can be evaluated at compile time.
+constexpr immortal_object constant_immortal {
+    utility::shared::immortal_tag(), 28};
+
+BOOST_AUTO_TEST_CASE (test_utility_shared_immortal) {
+    BOOST_CHECK_EQUAL (constant_immortal.value, 28);
+    BOOST_CHECK (shared::is_immortal (&constant_immortal));
+
+    BOOST_CHECK_EQUAL (global_immortal.value, 27);
+    BOOST_CHECK (shared::is_immortal (&global_immortal));
+    long count = shared::get_count (&global_immortal);
+
+    shared::acquire (&global_immortal);
+    BOOST_CHECK_EQUAL (shared::get_count (&global_immortal), count);
+    BOOST_CHECK (!shared::release_count (&global_immortal));
+    BOOST_CHECK (!shared::release_count (&global_immortal));
+    BOOST_CHECK_EQUAL (shared::get_count (&global_immortal), count);
+
+    // A copy is mortal.
+    immortal_object copy (global_immortal);
+    BOOST_CHECK (!shared::is_immortal (&copy));
+    BOOST_CHECK_EQUAL (shared::get_count (&copy), 0);
+
+    {
+        typedef utility::small_ptr <immortal_object> pointer_type;
+        std::allocator <immortal_object> allocator;
+        pointer_type p (&global_immortal, allocator);
+        pointer_type p2 = p;
+        BOOST_CHECK_EQUAL (p2->value, 27);
+        BOOST_CHECK (!p2.unique());
+    }
+    // The object has not been destructed.
+    BOOST_CHECK_EQUAL (global_immortal.value, 27);
+    BOOST_CHECK (shared::is_immortal (&global_immortal));
+}
+
+struct local_shared : utility::local_shared {};
+
+BOOST_AUTO_TEST_CASE (test_utility_local_shared_basic) {
+    local_shared s;
+    BOOST_CHECK_EQUAL (local_shared::get_count (&s), 0);
+    local_shared::acquire (&s);
+    BOOST_CHECK_EQUAL (local_shared::get_count (&s), 1);
+    local_shared::acquire (&s);
+    BOOST_CHECK_EQUAL (local_shared::get_count (&s), 2);
+
+    // Copying must not copy the count.
+    local_shared copy (s);
+    BOOST_CHECK_EQUAL (local_shared::get_count (&copy), 0);
+    copy = s;
+    BOOST_CHECK_EQUAL (local_shared::get_count (&copy), 0);
+
+    BOOST_CHECK (!local_shared::release_count (&s));
+    BOOST_CHECK_EQUAL (local_shared::get_count (&s), 1);
+    BOOST_CHECK (local_shared::release_count (&s));
+    BOOST_CHECK_EQUAL (local_shared::get_count (&s), 0);
+}
+
+struct padded_object : utility::padded_shared {
+    int value;
+    explicit padded_object (int value) : value (value) {}
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_padded_shared) {
+    // The count has a cache line of its own.
+    static_assert (alignof (padded_object) == 64, "");
+    static_assert (sizeof (padded_object) == 128, "");
+
+    typedef utility::test_allocator <std::allocator <padded_object>, true>
+        allocator_type;
+    typedef utility::small_ptr <padded_object, allocator_type> pointer_type;
+    utility::thrower thrower;
+    allocator_type allocator (thrower);
+    {
+        std::vector <pointer_type> pointers;
+        for (int i = 0; i != 10; ++ i) {
+            pointers.push_back (pointer_type::construct (allocator, i));
+            // The allocation must honour the alignment.
+            BOOST_CHECK_EQUAL (
+                reinterpret_cast <std::uintptr_t> (pointers.back().get()) % 64,
+                0u);
+            BOOST_CHECK_EQUAL (pointers.back()->value, i);
+        }
+        pointer_type copy = pointers.front();
+        BOOST_CHECK_EQUAL (copy.use_count(), 2);
+    }
+    // The test allocator checks that all memory has been deallocated.
+}
+
 template <bool t1, bool t2, bool t3, bool t4, bool t5, bool t6>
     struct test_exceptions
 {
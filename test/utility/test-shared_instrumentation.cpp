@@ -0,0 +1,134 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define UTILITY_SHARED_INSTRUMENTATION
+
+#define BOOST_TEST_MODULE test_utility_shared_instrumentation
+#include "utility/test/boost_unit_test.hpp"
+
+#include <string>
+#include <sstream>
+#include <memory>
+
+#include "utility/shared.hpp"
+#include "utility/small_ptr.hpp"
+#include "utility/shared_instrumentation.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_shared_instrumentation)
+
+struct counted : utility::shared {
+    int value;
+    explicit counted (int value) : value (value) {}
+};
+
+struct other_counted : utility::shared {};
+
+utility::shared_instrumentation::type_statistics
+    find_statistics (std::string const & name)
+{
+    for (auto const & statistics : utility::shared_instrumentation::snapshot())
+        if (statistics.name
+            == "test_suite_utility_shared_instrumentation::" + name)
+            return statistics;
+    BOOST_FAIL ("No statistics for " + name);
+    return utility::shared_instrumentation::type_statistics();
+}
+
+BOOST_AUTO_TEST_CASE (test_shared_instrumentation_counts) {
+    {
+        utility::small_ptr <counted> p
+            = utility::small_ptr <counted>::construct (
+                std::allocator <counted>(), 5);
+        utility::small_ptr <counted> q
+            = utility::small_ptr <counted>::construct (
+                std::allocator <counted>(), 6);
+        {
+            auto copy = p;
+            auto copy2 = copy;
+            auto moved = std::move (copy2);
+
+            auto statistics = find_statistics ("counted");
+            BOOST_CHECK_EQUAL (statistics.constructions, 2);
+            BOOST_CHECK_EQUAL (statistics.live, 2);
+            BOOST_CHECK_EQUAL (statistics.peak_live, 2);
+            BOOST_CHECK_EQUAL (statistics.destructions, 0);
+        }
+        q = p;
+        auto statistics = find_statistics ("counted");
+        BOOST_CHECK_EQUAL (statistics.live, 1);
+        BOOST_CHECK_EQUAL (statistics.destructions, 1);
+    }
+    auto statistics = find_statistics ("counted");
+    BOOST_CHECK_EQUAL (statistics.constructions, 2);
+    BOOST_CHECK_EQUAL (statistics.destructions, 2);
+    BOOST_CHECK_EQUAL (statistics.live, 0);
+    BOOST_CHECK_EQUAL (statistics.peak_live, 2);
+    // Every acquire, including the one on construction, is balanced by a
+    // release.
+    BOOST_CHECK_EQUAL (statistics.acquires, statistics.releases);
+    // Two constructions, two copies, and one assignment.
+    BOOST_CHECK_EQUAL (statistics.acquires, 5);
+}
+
+BOOST_AUTO_TEST_CASE (test_shared_instrumentation_dump) {
+    auto p = utility::small_ptr <other_counted>::construct (
+        std::allocator <other_counted>());
+    for (int i = 0; i != 100; ++ i) {
+        auto copy = p;
+    }
+    auto statistics = find_statistics ("other_counted");
+    BOOST_CHECK_EQUAL (statistics.acquires, 101);
+    BOOST_CHECK_EQUAL (statistics.releases, 100);
+    BOOST_CHECK_EQUAL (statistics.live, 1);
+
+    // Types with more traffic come first.
+    auto all = utility::shared_instrumentation::snapshot();
+    BOOST_REQUIRE_EQUAL (all.size(), 2u);
+    BOOST_CHECK (all.front().name.find ("other_counted")
+        != std::string::npos);
+
+    std::ostringstream stream;
+    utility::shared_instrumentation::dump (stream);
+    // Live and peak live are 1.
+    BOOST_CHECK (stream.str().find ("\t1\t1\t"
+        "test_suite_utility_shared_instrumentation::other_counted\n")
+        != std::string::npos);
+}
+
+struct deferred_counted : utility::shared {};
+
+/**
+Objects that are destructed when deferred releases are applied must be
+counted as destructed.
+*/
+BOOST_AUTO_TEST_CASE (test_shared_instrumentation_deferred) {
+    typedef utility::deferred_small_ptr <deferred_counted> pointer_type;
+    {
+        auto p = pointer_type::construct (std::allocator <deferred_counted>());
+        auto copy = p;
+    }
+    auto statistics = find_statistics ("deferred_counted");
+    BOOST_CHECK_EQUAL (statistics.constructions, 1);
+    BOOST_CHECK_EQUAL (statistics.destructions, 0);
+    BOOST_CHECK_EQUAL (statistics.live, 1);
+
+    utility::pointer_policy::flush_deferred_releases();
+    statistics = find_statistics ("deferred_counted");
+    BOOST_CHECK_EQUAL (statistics.destructions, 1);
+    BOOST_CHECK_EQUAL (statistics.live, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
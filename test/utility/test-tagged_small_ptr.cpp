@@ -0,0 +1,135 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_tagged_small_ptr
+#include "utility/test/boost_unit_test.hpp"
+
+#include <memory>
+#include <set>
+
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+struct object : utility::shared {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+struct node;
+
+typedef utility::tagged_small_ptr <node, 2> node_ptr;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <node> {
+        node_ptr && operator() (node * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+struct node : utility::shared {
+    int value_;
+    node_ptr next_;
+
+    explicit node (int value)
+    : value_ (value), next_ (std::allocator <node>()) {}
+};
+
+inline node_ptr &&
+    utility::pointer_policy::move_recursive_next <node>::operator() (
+        node * object) const
+{ return std::move (object->next_); }
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_tagged_small_ptr)
+
+typedef utility::tagged_small_ptr <object, 3> pointer_type;
+
+BOOST_AUTO_TEST_CASE (test_utility_tagged_small_ptr_basic) {
+    static_assert (sizeof (pointer_type) == sizeof (void *), "");
+
+    utility::tracked_registry registry;
+    std::allocator <object> allocator;
+    {
+        pointer_type empty (allocator);
+        BOOST_CHECK (!empty);
+        empty.set_tag (5);
+        BOOST_CHECK (!empty);
+        BOOST_CHECK (empty.get() == nullptr);
+        BOOST_CHECK_EQUAL (empty.tag(), 5u);
+
+        pointer_type p = pointer_type::construct (allocator, registry, 17);
+        BOOST_CHECK_EQUAL (p.tag(), 0u);
+        object * address = p.get();
+        p.set_tag (7);
+        BOOST_CHECK_EQUAL (p.tag(), 7u);
+        BOOST_CHECK (p.get() == address);
+        BOOST_CHECK_EQUAL (p->value.content(), 17);
+
+        // Only the lowest bits are kept.
+        p.set_tag (9);
+        BOOST_CHECK_EQUAL (p.tag(), 1u);
+
+        // Copies get the tag, but it is not shared.
+        pointer_type q = p;
+        BOOST_CHECK_EQUAL (q.tag(), 1u);
+        BOOST_CHECK_EQUAL (p.use_count(), 2);
+        q.set_tag (6);
+        BOOST_CHECK_EQUAL (p.tag(), 1u);
+
+        // Comparisons ignore the tag.
+        BOOST_CHECK (p == q);
+        BOOST_CHECK (!(p < q));
+        BOOST_CHECK (!(q < p));
+
+        {
+            std::set <pointer_type> pointers;
+            pointers.insert (p);
+            pointers.insert (q);
+            BOOST_CHECK_EQUAL (pointers.size(), 1u);
+        }
+
+        empty = q;
+        BOOST_CHECK_EQUAL (empty.tag(), 6u);
+        BOOST_CHECK_EQUAL (p.use_count(), 3);
+
+        swap (p, q);
+        BOOST_CHECK_EQUAL (p.tag(), 6u);
+        BOOST_CHECK_EQUAL (q.tag(), 1u);
+
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+    }
+    BOOST_CHECK_EQUAL (registry.alive_count(), 0);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_tagged_small_ptr_list) {
+    std::allocator <node> allocator;
+    node_ptr first (allocator);
+    node_ptr * current = &first;
+    for (int i = 0; i != 100000; ++ i) {
+        *current = node_ptr::construct (allocator, i);
+        current->set_tag (unsigned (i % 4));
+        current = &(*current)->next_;
+    }
+    BOOST_CHECK_EQUAL (first->next_.tag(), 1u);
+    BOOST_CHECK_EQUAL (first->next_->next_->value_, 2);
+    // Destruction is iterative.
+    first = node_ptr (allocator);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
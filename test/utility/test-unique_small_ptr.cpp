@@ -0,0 +1,195 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_unique_small_ptr
+#include "utility/test/boost_unit_test.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+#include "utility/small_ptr.hpp"
+
+#include "utility/test/tracked.hpp"
+
+typedef utility::unique_small_ptr <utility::tracked <int>> pointer_type;
+
+struct node;
+
+typedef utility::unique_small_ptr <node> node_ptr;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <node> {
+        node_ptr && operator() (node * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+/// Node that does not derive from utility::shared.
+struct node {
+    int value_;
+    node_ptr next_;
+
+    explicit node (int value)
+    : value_ (value), next_ (std::allocator <node>()) {}
+};
+
+inline node_ptr &&
+    utility::pointer_policy::move_recursive_next <node>::operator() (
+        node * object) const
+{ return std::move (object->next_); }
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_unique_small_ptr)
+
+BOOST_AUTO_TEST_CASE (test_utility_unique_small_ptr_basic) {
+    static_assert (sizeof (pointer_type) == sizeof (void *), "");
+    static_assert (!std::is_copy_constructible <pointer_type>::value, "");
+    static_assert (!std::is_copy_assignable <pointer_type>::value, "");
+    static_assert (
+        std::is_nothrow_move_constructible <pointer_type>::value, "");
+
+    utility::tracked_registry registry;
+    std::allocator <utility::tracked <int>> allocator;
+    {
+        pointer_type empty (allocator);
+        BOOST_CHECK (!empty);
+        BOOST_CHECK (empty.get() == nullptr);
+        BOOST_CHECK_EQUAL (empty.use_count(), 0);
+        BOOST_CHECK (!empty.unique());
+
+        pointer_type p = pointer_type::construct (allocator, registry, 7);
+        BOOST_CHECK (p);
+        BOOST_CHECK (p.unique());
+        BOOST_CHECK_EQUAL (p.use_count(), 1);
+        BOOST_CHECK_EQUAL (p->content(), 7);
+        BOOST_CHECK_EQUAL (registry.alive_count(), 1);
+
+        // Move construction.
+        utility::tracked <int> * address = p.get();
+        pointer_type q (std::move (p));
+        BOOST_CHECK (!p);
+        BOOST_CHECK (q.get() == address);
+        BOOST_CHECK_EQUAL (registry.alive_count(), 1);
+
+        // Move assignment to an empty pointer.
+        empty = std::move (q);
+        BOOST_CHECK (!q);
+        BOOST_CHECK (empty.get() == address);
+
+        // Move assignment destructs the object that was owned.
+        p = pointer_type::construct (allocator, registry, 8);
+        BOOST_CHECK_EQUAL (registry.alive_count(), 2);
+        empty = std::move (p);
+        BOOST_CHECK_EQUAL (registry.alive_count(), 1);
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+        BOOST_CHECK_EQUAL (empty->content(), 8);
+
+        // Assigning an empty pointer destructs the object.
+        empty = pointer_type (allocator);
+        BOOST_CHECK_EQUAL (registry.alive_count(), 0);
+
+        p = pointer_type::construct (allocator, registry, 9);
+        q = pointer_type::construct (allocator, registry, 10);
+        swap (p, q);
+        BOOST_CHECK_EQUAL (p->content(), 10);
+        BOOST_CHECK_EQUAL (q->content(), 9);
+        BOOST_CHECK (p != q);
+    }
+    // Destruction at the end of the scope.
+    BOOST_CHECK_EQUAL (registry.alive_count(), 0);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_unique_small_ptr_list) {
+    std::allocator <node> allocator;
+    node_ptr first (allocator);
+    node_ptr * current = &first;
+    for (int i = 0; i != 1000000; ++ i) {
+        *current = node_ptr::construct (allocator, i);
+        current = &(*current)->next_;
+    }
+    BOOST_CHECK_EQUAL (first->next_->next_->value_, 2);
+
+    // Assigning the second node to the first destructs the first node, which
+    // owns the second one.
+    first = std::move (first->next_);
+    BOOST_CHECK_EQUAL (first->value_, 1);
+
+    // Destruction is iterative.
+    first = node_ptr (allocator);
+    BOOST_CHECK (!first);
+}
+
+struct shared_object : utility::shared {
+    utility::tracked <int> value;
+
+    shared_object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+struct compact_object : utility::compact_shared <std::uint32_t> {
+    int value;
+
+    explicit compact_object (int value) : value (value) {}
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_unique_small_ptr_to_small_ptr) {
+    typedef utility::unique_small_ptr <shared_object> unique_type;
+    typedef utility::small_ptr <shared_object> shared_type;
+    static_assert (
+        std::is_convertible <unique_type &&, shared_type>::value, "");
+    static_assert (
+        !std::is_convertible <unique_type const &, shared_type>::value, "");
+
+    utility::tracked_registry registry;
+    std::allocator <shared_object> allocator;
+    {
+        unique_type u = unique_type::construct (allocator, registry, 4);
+        // The count is not touched while the object is unique.
+        BOOST_CHECK_EQUAL (utility::shared::get_count (u.get()), 0);
+        u->value = utility::tracked <int> (registry, 5);
+        shared_object * address = u.get();
+
+        shared_type s = std::move (u);
+        BOOST_CHECK (!u);
+        BOOST_CHECK (s.get() == address);
+        BOOST_CHECK (s.unique());
+        BOOST_CHECK_EQUAL (s->value.content(), 5);
+
+        shared_type s2 = s;
+        BOOST_CHECK_EQUAL (s.use_count(), 2);
+        s = shared_type (allocator);
+        BOOST_CHECK (s2.unique());
+
+        // An empty pointer converts to an empty pointer.
+        shared_type empty = unique_type (allocator);
+        BOOST_CHECK (!empty);
+        BOOST_CHECK_EQUAL (registry.alive_count(), 1);
+    }
+    BOOST_CHECK_EQUAL (registry.alive_count(), 0);
+
+    // Other count types use their normal acquire.
+    {
+        typedef utility::unique_small_ptr <compact_object> unique_type;
+        std::allocator <compact_object> allocator;
+        utility::small_ptr <compact_object> s
+            = unique_type::construct (allocator, 6);
+        BOOST_CHECK (s.unique());
+        BOOST_CHECK_EQUAL (s->value, 6);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
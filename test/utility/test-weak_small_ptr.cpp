@@ -0,0 +1,153 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_utility_weak_small_ptr
+#include "utility/test/boost_unit_test.hpp"
+
+#include <memory>
+
+#include "utility/weak_small_ptr.hpp"
+
+#include "utility/test/test_allocator.hpp"
+#include "utility/test/tracked.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_weak_small_ptr)
+
+struct object : utility::weak_shared {
+    utility::tracked <int> value;
+
+    object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+typedef utility::test_allocator <std::allocator <object>, true>
+    allocator_type;
+typedef utility::small_ptr <object, allocator_type> pointer_type;
+typedef utility::weak_small_ptr <object, allocator_type> weak_pointer_type;
+
+BOOST_AUTO_TEST_CASE (test_utility_weak_small_ptr_basic) {
+    utility::thrower thrower;
+    allocator_type allocator (thrower);
+    utility::tracked_registry registry;
+
+    weak_pointer_type empty (allocator);
+    BOOST_CHECK (empty.expired());
+    BOOST_CHECK_EQUAL (empty.use_count(), 0);
+    BOOST_CHECK (!empty.lock());
+
+    weak_pointer_type w (allocator);
+    {
+        pointer_type p = pointer_type::construct (allocator, registry, 5);
+        w = p;
+        BOOST_CHECK (!w.expired());
+        BOOST_CHECK_EQUAL (w.use_count(), 1);
+        BOOST_CHECK_EQUAL (utility::weak_shared::get_weak_count (p.get()), 2);
+        {
+            pointer_type p2 = w.lock();
+            BOOST_CHECK (p2 == p);
+            BOOST_CHECK_EQUAL (p.use_count(), 2);
+        }
+        BOOST_CHECK (p.unique());
+
+        weak_pointer_type w2 = w;
+        BOOST_CHECK_EQUAL (utility::weak_shared::get_weak_count (p.get()), 3);
+        weak_pointer_type w3 = std::move (w2);
+        BOOST_CHECK (w2.expired());
+        BOOST_CHECK_EQUAL (utility::weak_shared::get_weak_count (p.get()), 3);
+        w3.reset();
+        BOOST_CHECK_EQUAL (utility::weak_shared::get_weak_count (p.get()), 2);
+        BOOST_CHECK_EQUAL (registry.destruct_count(), 0);
+    }
+    // The object is destructed, but the memory is still there.
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+    BOOST_CHECK (w.expired());
+    BOOST_CHECK (!w.lock());
+    weak_pointer_type w2 = w;
+    BOOST_CHECK (w2.expired());
+
+    // The memory is deallocated with the last weak reference.
+    // The test allocator checks this.
+    w.reset();
+    w2.reset();
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_weak_small_ptr_no_weak) {
+    // Without weak references, the memory is deallocated with the object.
+    utility::thrower thrower;
+    allocator_type allocator (thrower);
+    utility::tracked_registry registry;
+    {
+        pointer_type p = pointer_type::construct (allocator, registry, 5);
+        weak_pointer_type w (p);
+    }
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+    {
+        pointer_type p = pointer_type::construct (allocator, registry, 6);
+    }
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 2);
+}
+
+/*
+weak_shared is not at the start of this object, so the counts are at an
+offset from its address.
+After the object has been destructed, weak pointers must find the counts
+without converting the pointer to the base class.
+*/
+struct other_base {
+    long other;
+
+    other_base() : other (7) {}
+    virtual ~other_base() { other = 0; }
+};
+
+struct offset_object : other_base, utility::weak_shared {
+    utility::tracked <int> value;
+
+    offset_object (utility::tracked_registry & registry, int value)
+    : value (registry, value) {}
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_weak_small_ptr_offset) {
+    typedef utility::test_allocator <std::allocator <offset_object>, true>
+        allocator_type;
+    typedef utility::small_ptr <offset_object, allocator_type> pointer_type;
+    typedef utility::weak_small_ptr <offset_object, allocator_type>
+        weak_pointer_type;
+
+    utility::thrower thrower;
+    allocator_type allocator (thrower);
+    utility::tracked_registry registry;
+
+    weak_pointer_type w (allocator);
+    {
+        pointer_type p = pointer_type::construct (allocator, registry, 5);
+        w = p;
+        BOOST_CHECK_EQUAL (w.use_count(), 1);
+        BOOST_CHECK_EQUAL (utility::weak_shared::get_weak_count (p.get()), 2);
+        pointer_type p2 = w.lock();
+        BOOST_CHECK (p2 == p);
+        BOOST_CHECK_EQUAL (p.use_count(), 2);
+    }
+    BOOST_CHECK_EQUAL (registry.destruct_count(), 1);
+    BOOST_CHECK (w.expired());
+    BOOST_CHECK (!w.lock());
+    weak_pointer_type w2 = w;
+    BOOST_CHECK (w2.expired());
+    w.reset();
+    BOOST_CHECK (w2.expired());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
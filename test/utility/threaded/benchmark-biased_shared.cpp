@@ -0,0 +1,92 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Compare utility::shared and utility::biased_shared on a workload where the
+thread that created an object does almost all of the copying, and one other
+thread occasionally copies the object too.
+*/
+
+#define BOOST_TEST_MODULE test_utility_biased_shared_benchmark
+#include "utility/test/boost_unit_test.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include "utility/small_ptr.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_biased_shared_benchmark)
+
+static constexpr int owner_iteration_num = 10000000;
+static constexpr int other_iteration_num = 10000;
+
+struct shared_object : utility::shared {};
+struct biased_object : utility::biased_shared {};
+
+template <class Object> class other_thread {
+    utility::small_ptr <Object> object;
+public:
+    explicit other_thread (utility::small_ptr <Object> const & object)
+    : object (object) {}
+
+    void operator() () const {
+        for (int i = 0; i != other_iteration_num; ++ i)
+            utility::small_ptr <Object> copy = object;
+    }
+};
+
+/**
+\return The time in milliseconds that it takes for the owner thread to copy
+the pointer owner_iteration_num times, while another thread copies it
+other_iteration_num times.
+*/
+template <class Object> double time_owner_dominated() {
+    typedef utility::small_ptr <Object> pointer_type;
+    pointer_type object = pointer_type::construct (std::allocator <Object>());
+
+    // Summing the use counts stops the compiler from optimising the loop away.
+    long use_count_sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    boost::thread other ((other_thread <Object> (object)));
+    for (int i = 0; i != owner_iteration_num; ++ i) {
+        pointer_type copy = object;
+        use_count_sum += copy.use_count();
+    }
+    other.join();
+    auto end = std::chrono::steady_clock::now();
+
+    BOOST_CHECK (use_count_sum >= 2l * owner_iteration_num);
+    // The other thread may have handed its reference back to this thread.
+    utility::biased_shared::merge_queued();
+    BOOST_CHECK (object.unique());
+    return std::chrono::duration <double, std::milli> (end - start).count();
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_biased_shared_benchmark) {
+    double shared_time = time_owner_dominated <shared_object>();
+    double biased_time = time_owner_dominated <biased_object>();
+
+    std::cout << "Owner-dominated workload, " << owner_iteration_num
+        << " copies on the owner thread:\n"
+        << "  utility::shared:        " << shared_time << " ms\n"
+        << "  utility::biased_shared: " << biased_time << " ms"
+        << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
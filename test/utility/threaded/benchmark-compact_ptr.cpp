@@ -0,0 +1,150 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Compare the time it takes to traverse a list of nodes that are in memory in
+a random order, for small_ptr with utility::shared and for compact_ptr with
+utility::compact_shared.
+The compact nodes are half the size, so more of them fit in the cache.
+*/
+
+#define BOOST_TEST_MODULE test_utility_compact_ptr_benchmark
+#include "utility/test/boost_unit_test.hpp"
+
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "utility/compact_region.hpp"
+#include "utility/compact_shared.hpp"
+#include "utility/small_ptr.hpp"
+
+struct test_region_tag;
+typedef utility::compact_region <test_region_tag> test_region;
+
+struct big_node;
+struct compact_node;
+
+typedef utility::small_ptr <big_node> big_node_ptr;
+typedef utility::compact_ptr <compact_node, test_region> compact_node_ptr;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <big_node> {
+        big_node_ptr && operator() (big_node * object) const;
+    };
+
+    template <> struct move_recursive_next <compact_node> {
+        compact_node_ptr && operator() (compact_node * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+/// Node with a 64-bit count and a 64-bit pointer.
+struct big_node : utility::shared {
+    int value_;
+    big_node_ptr next_;
+
+    explicit big_node (int value)
+    : value_ (value), next_ (std::allocator <big_node>()) {}
+};
+
+/// Node with a 32-bit count and a 32-bit pointer.
+struct compact_node : utility::compact_shared <std::uint32_t> {
+    int value_;
+    compact_node_ptr next_;
+
+    explicit compact_node (int value) : value_ (value) {}
+};
+
+inline big_node_ptr &&
+    utility::pointer_policy::move_recursive_next <big_node>::operator() (
+        big_node * object) const
+{ return std::move (object->next_); }
+
+inline compact_node_ptr &&
+    utility::pointer_policy::move_recursive_next <compact_node>::operator() (
+        compact_node * object) const
+{ return std::move (object->next_); }
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_compact_ptr_benchmark)
+
+static constexpr int node_num = 1 << 20;
+
+/**
+Make a list with nodes in memory in a random order, so that traversing it
+causes cache misses.
+*/
+template <class Pointer, class ... Allocator>
+    Pointer make_shuffled_list (Allocator const & ... allocator)
+{
+    std::vector <Pointer> nodes;
+    nodes.reserve (node_num);
+    for (int i = 0; i != node_num; ++ i)
+        nodes.push_back (Pointer::construct (allocator ..., i));
+    std::mt19937 generator (1234);
+    std::shuffle (nodes.begin(), nodes.end(), generator);
+    for (int i = 0; i != node_num - 1; ++ i)
+        nodes [i]->next_ = nodes [i + 1];
+    return nodes.front();
+}
+
+/**
+\return The time in milliseconds that it takes to traverse \a list five
+times.
+*/
+template <class Pointer> double time_traversal (Pointer const & list) {
+    long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat != 5; ++ repeat) {
+        for (auto node = list.get(); node; node = node->next_.get())
+            sum += node->value_;
+    }
+    auto end = std::chrono::steady_clock::now();
+    BOOST_CHECK_EQUAL (sum, 5 * (long (node_num) * (node_num - 1) / 2));
+    return std::chrono::duration <double, std::milli> (end - start).count();
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_compact_ptr_benchmark) {
+    test_region::initialize (std::size_t (node_num + 1) * sizeof (big_node));
+
+    double big_time;
+    {
+        big_node_ptr list = make_shuffled_list <big_node_ptr> (
+            std::allocator <big_node>());
+        big_time = time_traversal (list);
+    }
+    double compact_time;
+    {
+        compact_node_ptr list = make_shuffled_list <compact_node_ptr>();
+        compact_time = time_traversal (list);
+        BOOST_CHECK (test_region::used()
+            <= std::size_t (node_num + 1) * test_region::granularity);
+    }
+
+    std::cout << "Traversing a shuffled list of " << node_num << " nodes:\n"
+        << "  small_ptr, utility::shared (" << sizeof (big_node)
+        << " bytes per node): " << big_time << " ms\n"
+        << "  compact_ptr, utility::compact_shared (" << sizeof (compact_node)
+        << " bytes per node): " << compact_time << " ms" << std::endl;
+    test_region::release();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,164 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Producer/consumer stress test and benchmark for the allocators.
+Producer threads construct objects and pass them to consumer threads in
+batches; the consumer threads release them.
+With utility::magazine_allocator, the memory goes back to the producer.
+*/
+
+#define BOOST_TEST_MODULE test_utility_magazine_allocator_benchmark
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "utility/small_ptr.hpp"
+#include "utility/pool_allocator.hpp"
+#include "utility/magazine_allocator.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_magazine_allocator_benchmark)
+
+static constexpr int pair_num = 2;
+static constexpr int batch_num = 4000;
+static constexpr int batch_size = 256;
+
+struct message : utility::shared {
+    long value;
+    long check;
+    explicit message (long value) : value (value), check (~value) {}
+};
+
+/**
+Queue of batches of pointers, protected by a mutex.
+*/
+template <class Pointer> class queue {
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::deque <std::vector <Pointer>> batches;
+
+public:
+    void push (std::vector <Pointer> && batch) {
+        {
+            std::lock_guard <std::mutex> lock (mutex);
+            batches.push_back (std::move (batch));
+        }
+        not_empty.notify_one();
+    }
+
+    std::vector <Pointer> pop() {
+        std::unique_lock <std::mutex> lock (mutex);
+        while (batches.empty())
+            not_empty.wait (lock);
+        std::vector <Pointer> batch = std::move (batches.front());
+        batches.pop_front();
+        return batch;
+    }
+};
+
+template <class Allocator> class producer {
+    typedef utility::small_ptr <message, Allocator> pointer_type;
+    queue <pointer_type> & q;
+public:
+    explicit producer (queue <pointer_type> & q) : q (q) {}
+
+    void operator() () const {
+        Allocator allocator;
+        for (int b = 0; b != batch_num; ++ b) {
+            std::vector <pointer_type> batch;
+            batch.reserve (batch_size);
+            for (int i = 0; i != batch_size; ++ i)
+                batch.push_back (pointer_type::construct (
+                    allocator, long (b) * batch_size + i));
+            q.push (std::move (batch));
+        }
+        // Signal the end.
+        q.push (std::vector <pointer_type>());
+    }
+};
+
+template <class Allocator> class consumer {
+    typedef utility::small_ptr <message, Allocator> pointer_type;
+    queue <pointer_type> & q;
+    std::atomic <long> & errors;
+public:
+    consumer (queue <pointer_type> & q, std::atomic <long> & errors)
+    : q (q), errors (errors) {}
+
+    void operator() () const {
+        while (true) {
+            std::vector <pointer_type> batch = q.pop();
+            if (batch.empty())
+                return;
+            for (pointer_type const & p : batch)
+                if (p->check != ~p->value || !p.unique())
+                    ++ errors;
+            // The batch is released here.
+        }
+    }
+};
+
+/**
+\return The time in milliseconds that it takes for pair_num producers to
+send batch_num * batch_size objects each to pair_num consumers.
+*/
+template <class Allocator> double time_producer_consumer() {
+    typedef utility::small_ptr <message, Allocator> pointer_type;
+    std::vector <std::unique_ptr <queue <pointer_type>>> queues;
+    for (int p = 0; p != pair_num; ++ p)
+        queues.emplace_back (new queue <pointer_type>);
+    std::atomic <long> errors (0);
+
+    auto start = std::chrono::steady_clock::now();
+    boost::thread_group threads;
+    for (int p = 0; p != pair_num; ++ p) {
+        threads.create_thread (producer <Allocator> (*queues [p]));
+        threads.create_thread (consumer <Allocator> (*queues [p], errors));
+    }
+    threads.join_all();
+    auto end = std::chrono::steady_clock::now();
+
+    BOOST_CHECK_EQUAL (errors.load(), 0);
+    return std::chrono::duration <double, std::milli> (end - start).count();
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_magazine_allocator_benchmark) {
+    double standard_time
+        = time_producer_consumer <std::allocator <message>>();
+    double pool_time
+        = time_producer_consumer <utility::pool_allocator <message>>();
+    double magazine_time
+        = time_producer_consumer <utility::magazine_allocator <message>>();
+
+    std::cout << "Producer/consumer workload, " << pair_num
+        << " pairs of threads, " << batch_num * batch_size
+        << " objects per pair:\n"
+        << "  std::allocator:              " << standard_time << " ms\n"
+        << "  utility::pool_allocator:     " << pool_time << " ms\n"
+        << "  utility::magazine_allocator: " << magazine_time << " ms"
+        << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Compare utility::shared and utility::padded_shared on a workload where one
+thread keeps changing a field of an object while other threads keep copying
+pointers to it.
+With utility::shared, the field and the count are in the same cache line.
+*/
+
+#define BOOST_TEST_MODULE test_utility_padded_shared_benchmark
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include "utility/small_ptr.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_padded_shared_benchmark)
+
+static constexpr int copier_num = 3;
+static constexpr int iteration_num = 5000000;
+
+struct shared_object : utility::shared {
+    std::atomic <long> value;
+    shared_object() : value (0) {}
+};
+
+struct padded_object : utility::padded_shared {
+    std::atomic <long> value;
+    padded_object() : value (0) {}
+};
+
+template <class Object> class copier {
+    utility::small_ptr <Object> object;
+public:
+    explicit copier (utility::small_ptr <Object> const & object)
+    : object (object) {}
+
+    void operator() () const {
+        for (int i = 0; i != iteration_num; ++ i)
+            utility::small_ptr <Object> copy = object;
+    }
+};
+
+template <class Object> class mutator {
+    utility::small_ptr <Object> object;
+public:
+    explicit mutator (utility::small_ptr <Object> const & object)
+    : object (object) {}
+
+    void operator() () const {
+        for (int i = 0; i != iteration_num; ++ i)
+            object->value.store (i, std::memory_order_relaxed);
+    }
+};
+
+/**
+\return The time in milliseconds that it takes for one thread to write to the
+object iteration_num times, while copier_num threads copy pointers to it
+iteration_num times each.
+*/
+template <class Object> double time_mutate_while_sharing() {
+    typedef utility::small_ptr <Object> pointer_type;
+    pointer_type object = pointer_type::construct (std::allocator <Object>());
+
+    auto start = std::chrono::steady_clock::now();
+    boost::thread_group threads;
+    threads.create_thread (mutator <Object> (object));
+    for (int t = 0; t != copier_num; ++ t)
+        threads.create_thread (copier <Object> (object));
+    threads.join_all();
+    auto end = std::chrono::steady_clock::now();
+
+    BOOST_CHECK (object.unique());
+    BOOST_CHECK_EQUAL (object->value.load(), iteration_num - 1);
+    return std::chrono::duration <double, std::milli> (end - start).count();
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_padded_shared_benchmark) {
+    double shared_time = time_mutate_while_sharing <shared_object>();
+    double padded_time = time_mutate_while_sharing <padded_object>();
+
+    std::cout << "Mutate-while-sharing workload, 1 writer and " << copier_num
+        << " copying threads, " << iteration_num << " iterations each:\n"
+        << "  utility::shared:        " << shared_time << " ms\n"
+        << "  utility::padded_shared: " << padded_time << " ms"
+        << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,125 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Compare the time it takes to make and destruct a long linked list with
+std::allocator and with utility::pool_allocator.
+*/
+
+#define BOOST_TEST_MODULE test_utility_pool_allocator_benchmark
+#include "utility/test/boost_unit_test.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include "utility/small_ptr.hpp"
+#include "utility/pool_allocator.hpp"
+
+static constexpr std::size_t node_num = 500000;
+
+struct node;
+struct pool_node;
+
+typedef utility::small_ptr <node> node_ptr;
+typedef utility::small_ptr <pool_node, utility::pool_allocator <pool_node>>
+    pool_node_ptr;
+
+// Supply access to the pointer to the next element.
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <node> {
+        node_ptr && operator() (node * object) const;
+    };
+
+    template <> struct move_recursive_next <pool_node> {
+        pool_node_ptr && operator() (pool_node * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+/**
+Node for a linked list that is allocated with std::allocator.
+*/
+struct node : utility::shared {
+    int value_;
+    node_ptr next_;
+
+    node (int value) : value_ (value), next_ (std::allocator <node>()) {}
+};
+
+inline node_ptr &&
+    utility::pointer_policy::move_recursive_next <node>::operator() (
+        node * object) const
+{ return std::move (object->next_); }
+
+/**
+Node for a linked list that is allocated from a pool.
+*/
+struct pool_node : utility::shared {
+    int value_;
+    pool_node_ptr next_;
+
+    pool_node (int value)
+    : value_ (value), next_ (utility::pool_allocator <pool_node>()) {}
+};
+
+inline pool_node_ptr &&
+    utility::pointer_policy::move_recursive_next <pool_node>::operator() (
+        pool_node * object) const
+{ return std::move (object->next_); }
+
+BOOST_AUTO_TEST_SUITE (test_suite_utility_pool_allocator_benchmark)
+
+template <class Pointer> Pointer make_list (std::size_t number) {
+    typedef Pointer pointer_type;
+    typename pointer_type::allocator_type allocator;
+    pointer_type first (allocator);
+    pointer_type * current = &first;
+    for (std::size_t i = 0; i != number; ++ i) {
+        *current = pointer_type::construct (allocator, i);
+        current = &(*current)->next_;
+    }
+    return first;
+}
+
+/**
+\return The time in milliseconds that it takes to make a list of node_num
+nodes and destruct it.
+*/
+template <class Pointer> double time_make_and_destruct_list() {
+    auto start = std::chrono::steady_clock::now();
+    {
+        auto l = make_list <Pointer> (node_num);
+        BOOST_CHECK (l.unique());
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration <double, std::milli> (end - start).count();
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_pool_allocator_benchmark) {
+    // Run each once to warm up, and once to time.
+    time_make_and_destruct_list <node_ptr>();
+    time_make_and_destruct_list <pool_node_ptr>();
+    double standard_time = time_make_and_destruct_list <node_ptr>();
+    double pool_time = time_make_and_destruct_list <pool_node_ptr>();
+    std::cout << "Making and destructing a list of " << node_num
+        << " nodes:\n"
+        << "  std::allocator:          " << standard_time << " ms\n"
+        << "  utility::pool_allocator: " << pool_time << " ms" << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
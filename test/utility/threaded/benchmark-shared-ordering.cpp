@@ -0,0 +1,155 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Compare the speed of the memory orderings that utility::shared could use for
+its reference count.
+The "sequentially consistent" version is what a plain atomic counter does: every
+increment and decrement is a full barrier.
+The "acquire/release" version is what utility::shared does: increments are
+relaxed, decrements have release semantics, and an acquire fence is only issued
+when the last reference is dropped.
+
+On x86 the atomic read-modify-write instructions are the same for both; the
+difference is mainly in what the compiler is allowed to reorder around them.
+On architectures with weaker memory models, the difference is larger.
+*/
+
+#define BOOST_TEST_MODULE test_utility_shared_ordering_benchmark
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include "utility/small_ptr.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_shared_ordering_benchmark)
+
+static constexpr int thread_num = 4;
+static constexpr int iteration_num = 1000000;
+
+/**
+Reference count with the behaviour of boost::detail::atomic_count.
+*/
+struct sequentially_consistent {
+    static void acquire (std::atomic <long> & count)
+    { ++ count; }
+
+    static bool release_count (std::atomic <long> & count)
+    { return ! -- count; }
+};
+
+/**
+Reference count with the behaviour of utility::shared.
+*/
+struct acquire_release {
+    static void acquire (std::atomic <long> & count)
+    { count.fetch_add (1, std::memory_order_relaxed); }
+
+    static bool release_count (std::atomic <long> & count) {
+        if (count.fetch_sub (1, std::memory_order_release) == 1) {
+            std::atomic_thread_fence (std::memory_order_acquire);
+            return true;
+        }
+        return false;
+    }
+};
+
+/**
+Object with a count that is manipulated with the methods of Ordering.
+*/
+template <class Ordering> class counted_object {
+    std::atomic <long> count_;
+    std::atomic <bool> released_;
+public:
+    counted_object() : count_ (1), released_ (false) {}
+
+    void operator() () {
+        for (int i = 0; i != iteration_num; ++ i) {
+            Ordering::acquire (count_);
+            // Boost.Test is not thread-safe, so record the result here.
+            if (Ordering::release_count (count_))
+                released_ = true;
+        }
+    }
+
+    /// \return true iff the count has ever dropped to zero.
+    bool released() const { return released_; }
+};
+
+class test_object : public utility::shared {};
+
+/**
+Copy and release a small_ptr that other threads copy and release too.
+*/
+class small_ptr_hammer {
+    typedef utility::small_ptr <test_object> small_ptr;
+    small_ptr object;
+public:
+    small_ptr_hammer()
+    : object (small_ptr::construct (std::allocator <test_object>())) {}
+
+    void operator() () const {
+        for (int i = 0; i != iteration_num; ++ i)
+            small_ptr copy = object;
+    }
+
+    bool unique() const { return object.unique(); }
+};
+
+/**
+Run "action" on thread_num threads at the same time.
+\return The time this took in milliseconds.
+*/
+template <class Action> double time_threads (Action & action) {
+    auto start = std::chrono::steady_clock::now();
+    {
+        boost::thread_group threads;
+        for (int i = 0; i != thread_num; ++ i)
+            threads.create_thread (std::ref (action));
+        threads.join_all();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration <double, std::milli> (end - start).count();
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_shared_ordering_benchmark) {
+    counted_object <sequentially_consistent> sequential;
+    counted_object <acquire_release> relaxed;
+    small_ptr_hammer hammer;
+
+    double sequential_time = time_threads (sequential);
+    double relaxed_time = time_threads (relaxed);
+    double small_ptr_time = time_threads (hammer);
+
+    // The original reference must have been kept throughout.
+    BOOST_CHECK (!sequential.released());
+    BOOST_CHECK (!relaxed.released());
+    BOOST_CHECK (hammer.unique());
+
+    std::cout << thread_num << " threads, " << iteration_num
+        << " acquire/release pairs each:\n"
+        << "  sequentially consistent: " << sequential_time << " ms\n"
+        << "  acquire/release:         " << relaxed_time << " ms\n"
+        << "  utility::small_ptr copy: " << small_ptr_time << " ms"
+        << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Stress test for atomic_small_ptr: many threads load a snapshot of a table and
+check that it is consistent, while one thread keeps publishing new tables.
+*/
+
+#define BOOST_TEST_MODULE test_utility_atomic_small_ptr_threaded
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <memory>
+
+#include "utility/atomic_small_ptr.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_atomic_small_ptr_threaded)
+
+static constexpr int reader_num = 8;
+static constexpr int load_num = 100000;
+static constexpr int table_size = 16;
+
+std::atomic <int> construct_count (0);
+std::atomic <int> destruct_count (0);
+std::atomic <int> error_count (0);
+
+/**
+Table whose entries are all equal while it is alive.
+The destructor overwrites them, so that a reader that sees a destructed table
+notices.
+*/
+class table : public utility::shared {
+    std::atomic <int> entries [table_size];
+public:
+    explicit table (int value) {
+        for (auto & entry : entries)
+            entry.store (value, std::memory_order_relaxed);
+        ++ construct_count;
+    }
+
+    ~table() {
+        for (auto & entry : entries)
+            entry.store (-1, std::memory_order_relaxed);
+        ++ destruct_count;
+    }
+
+    bool consistent() const {
+        int first = entries [0].load (std::memory_order_relaxed);
+        if (first < 0)
+            return false;
+        for (auto & entry : entries)
+            if (entry.load (std::memory_order_relaxed) != first)
+                return false;
+        return true;
+    }
+};
+
+typedef utility::small_ptr <table> pointer_type;
+typedef utility::atomic_small_ptr <table> atomic_pointer_type;
+
+class reader {
+    atomic_pointer_type & current;
+public:
+    explicit reader (atomic_pointer_type & current) : current (current) {}
+
+    void operator() () const {
+        for (int i = 0; i != load_num; ++ i) {
+            pointer_type snapshot = current.load();
+            if (!snapshot || !snapshot->consistent())
+                ++ error_count;
+        }
+    }
+};
+
+class writer {
+    atomic_pointer_type & current;
+    std::atomic <bool> & done;
+public:
+    writer (atomic_pointer_type & current, std::atomic <bool> & done)
+    : current (current), done (done) {}
+
+    void operator() () const {
+        std::allocator <table> allocator;
+        for (int value = 1; !done.load (std::memory_order_relaxed); ++ value) {
+            if (value % 2)
+                current.store (pointer_type::construct (allocator, value));
+            else {
+                pointer_type expected = current.load();
+                while (!current.compare_exchange_weak (expected,
+                        pointer_type::construct (allocator, value)))
+                    ;
+            }
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_atomic_small_ptr_threaded) {
+    {
+        atomic_pointer_type current (pointer_type::construct (
+            std::allocator <table>(), 0));
+        std::atomic <bool> done (false);
+
+        boost::thread write_thread ((writer (current, done)));
+        boost::thread_group readers;
+        for (int t = 0; t != reader_num; ++ t)
+            readers.create_thread (reader (current));
+        readers.join_all();
+        done.store (true);
+        // The writer releases its retired references when it exits.
+        write_thread.join();
+
+        BOOST_CHECK_EQUAL (error_count.load(), 0);
+        BOOST_CHECK_EQUAL (destruct_count.load(), construct_count.load() - 1);
+    }
+    BOOST_CHECK_EQUAL (destruct_count.load(), construct_count.load());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,213 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Test that biased reference counting works when objects are shared between the
+owner thread and other threads.
+References acquired by the owner are released by other threads, and the owner
+lets go of the object while other threads are still using it.
+If the counts are merged incorrectly, objects are leaked or destructed twice.
+*/
+
+#define BOOST_TEST_MODULE test_utility_biased_shared_threaded
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "utility/small_ptr.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_biased_shared_threaded)
+
+static constexpr int round_num = 2000;
+static constexpr int thread_num = 3;
+static constexpr int copy_num = 200;
+
+std::atomic <int> construct_count (0);
+std::atomic <int> destruct_count (0);
+
+class test_object : public utility::biased_shared {
+public:
+    test_object() { ++ construct_count; }
+    ~test_object() { ++ destruct_count; }
+};
+
+typedef utility::small_ptr <test_object> pointer_type;
+
+/**
+Take ownership of a pointer that was copied by the owner thread, make more
+copies in this thread, and release them all.
+*/
+class user {
+    pointer_type object;
+public:
+    explicit user (pointer_type const & object) : object (object) {}
+
+    void operator() () {
+        std::vector <pointer_type> copies;
+        for (int i = 0; i != copy_num; ++ i)
+            copies.push_back (object);
+        // Release the reference that the owner acquired.
+        object = pointer_type (std::allocator <test_object>());
+        copies.clear();
+    }
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_biased_shared_threaded) {
+    for (int round = 0; round != round_num; ++ round) {
+        boost::thread_group threads;
+        {
+            pointer_type object = pointer_type::construct (
+                std::allocator <test_object>());
+            for (int t = 0; t != thread_num; ++ t)
+                threads.create_thread (user (object));
+            // Make some copies on the owner thread while the other threads
+            // are using the object.
+            for (int i = 0; i != copy_num; ++ i)
+                pointer_type copy = object;
+            // The owner releases its reference here, often before the other
+            // threads have finished.
+        }
+        threads.join_all();
+        // The other threads may have handed references back to this thread,
+        // which keep the object alive until they are processed.
+        utility::biased_shared::merge_queued();
+        BOOST_CHECK_EQUAL (destruct_count.load(), construct_count.load());
+    }
+    BOOST_CHECK_EQUAL (construct_count.load(), round_num);
+    BOOST_CHECK_EQUAL (destruct_count.load(), round_num);
+}
+
+/**
+Construct an object on a thread that then exits, so that the object's owner no
+longer exists when the last reference is released.
+*/
+class short_lived_owner {
+    pointer_type & result;
+public:
+    explicit short_lived_owner (pointer_type & result) : result (result) {}
+
+    void operator() () const {
+        pointer_type object = pointer_type::construct (
+            std::allocator <test_object>());
+        // Acquire a few more references.
+        result = object;
+        pointer_type copy = result;
+    }
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_biased_shared_owner_exited) {
+    int constructed = construct_count;
+    int destructed = destruct_count;
+    {
+        std::allocator <test_object> allocator;
+        pointer_type object (allocator);
+        boost::thread owner ((short_lived_owner (object)));
+        owner.join();
+
+        BOOST_CHECK_EQUAL (construct_count.load(), constructed + 1);
+        BOOST_CHECK_EQUAL (destruct_count.load(), destructed);
+        BOOST_CHECK (object.unique());
+
+        pointer_type copy = object;
+        BOOST_CHECK_EQUAL (object.use_count(), 2);
+    }
+    // This thread has merged the counts itself.
+    BOOST_CHECK_EQUAL (destruct_count.load(), destructed + 1);
+}
+
+/// Release all pointers in a vector.
+class releaser {
+    std::vector <pointer_type> & pointers;
+public:
+    explicit releaser (std::vector <pointer_type> & pointers)
+    : pointers (pointers) {}
+
+    void operator() () const { pointers.clear(); }
+};
+
+/**
+Another thread releases two references that the owner acquired.
+The first one is handed back to the owner; the second one makes the shared
+count negative.
+The count that the owner sees must still be exact.
+*/
+BOOST_AUTO_TEST_CASE (test_utility_biased_shared_negative_shared_count) {
+    int destructed = destruct_count;
+    {
+        pointer_type object = pointer_type::construct (
+            std::allocator <test_object>());
+        std::vector <pointer_type> copies (2, object);
+        BOOST_CHECK_EQUAL (object.use_count(), 3);
+
+        boost::thread other ((releaser (copies)));
+        other.join();
+
+        // The reference that was handed back still counts.
+        BOOST_CHECK_EQUAL (object.use_count(), 2);
+        BOOST_CHECK (!object.unique());
+
+        utility::biased_shared::merge_queued();
+        BOOST_CHECK_EQUAL (object.use_count(), 1);
+        BOOST_CHECK (object.unique());
+        BOOST_CHECK_EQUAL (destruct_count.load(), destructed);
+    }
+    BOOST_CHECK_EQUAL (destruct_count.load(), destructed + 1);
+}
+
+/**
+Hold pointers in a thread_local object, which is constructed before the queue
+of the thread, and therefore destructed after it.
+Its destructor acquires references to an object that the thread owns, and
+to a new object.
+*/
+struct late_owner {
+    std::vector <pointer_type> pointers;
+
+    ~late_owner() {
+        std::allocator <test_object> allocator;
+        pointer_type copy = pointers.front();
+        pointer_type fresh = pointer_type::construct (allocator);
+        pointer_type fresh_copy = fresh;
+        pointers.clear();
+    }
+
+    static late_owner & current() {
+        static thread_local late_owner instance;
+        return instance;
+    }
+};
+
+void use_late_owner() {
+    late_owner & owner = late_owner::current();
+    // This constructs the queue.
+    owner.pointers.push_back (
+        pointer_type::construct (std::allocator <test_object>()));
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_biased_shared_late_acquire) {
+    int constructed = construct_count;
+    int destructed = destruct_count;
+    boost::thread thread (use_late_owner);
+    thread.join();
+    BOOST_CHECK_EQUAL (construct_count.load(), constructed + 2);
+    BOOST_CHECK_EQUAL (destruct_count.load(), destructed + 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,79 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Test that releases from destructors of thread_local objects that run after
+the buffer of deferred releases has been destructed are not lost.
+*/
+
+#define BOOST_TEST_MODULE test_utility_deferred_release_threaded
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "utility/deferred_release.hpp"
+#include "utility/small_ptr.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_deferred_release_threaded)
+
+std::atomic <int> destruct_count (0);
+
+struct counted : utility::shared {
+    ~counted() { ++ destruct_count; }
+};
+
+typedef utility::deferred_small_ptr <counted> pointer_type;
+
+/**
+Hold pointers in a thread_local object, which is constructed before the
+buffer, and therefore destructed after it.
+*/
+struct late_owner {
+    std::vector <pointer_type> pointers;
+
+    ~late_owner() {
+        // Acquire and release after the buffer has gone.
+        pointer_type copy = pointers.front();
+        pointers.clear();
+    }
+
+    static late_owner & current() {
+        static thread_local late_owner instance;
+        return instance;
+    }
+};
+
+void use_late_owner() {
+    late_owner & owner = late_owner::current();
+    std::allocator <counted> allocator;
+    pointer_type p = pointer_type::construct (allocator);
+    owner.pointers.push_back (p);
+    owner.pointers.push_back (p);
+    // This release is deferred, so the buffer is constructed.
+    p = pointer_type (allocator);
+}
+
+BOOST_AUTO_TEST_CASE (test_utility_deferred_release_late_release) {
+    boost::thread thread (use_late_owner);
+    thread.join();
+    BOOST_CHECK_EQUAL (destruct_count.load(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
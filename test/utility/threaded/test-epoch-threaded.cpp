@@ -0,0 +1,134 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Stress test for epoch-based reclamation: many threads read a table through a
+shared pointer, while one thread keeps replacing the table and retiring the
+old one.
+*/
+
+#define BOOST_TEST_MODULE test_utility_epoch_threaded
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <memory>
+
+#include "utility/small_ptr.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_epoch_threaded)
+
+static constexpr int reader_num = 8;
+static constexpr int read_num = 100000;
+static constexpr int table_size = 16;
+
+std::atomic <int> construct_count (0);
+std::atomic <int> destruct_count (0);
+std::atomic <int> error_count (0);
+
+/**
+Table whose entries are all equal while it is alive.
+The destructor overwrites them, so that a reader that sees a destructed table
+notices.
+*/
+class table {
+    std::atomic <int> entries [table_size];
+public:
+    explicit table (int value) {
+        for (auto & entry : entries)
+            entry.store (value, std::memory_order_relaxed);
+        ++ construct_count;
+    }
+
+    ~table() {
+        for (auto & entry : entries)
+            entry.store (-1, std::memory_order_relaxed);
+        ++ destruct_count;
+    }
+
+    bool consistent() const {
+        int first = entries [0].load (std::memory_order_relaxed);
+        if (first < 0)
+            return false;
+        for (auto & entry : entries)
+            if (entry.load (std::memory_order_relaxed) != first)
+                return false;
+        return true;
+    }
+};
+
+typedef utility::epoch_ptr <table> pointer_type;
+
+class reader {
+    std::atomic <table *> & current;
+public:
+    explicit reader (std::atomic <table *> & current) : current (current) {}
+
+    void operator() () const {
+        for (int i = 0; i != read_num; ++ i) {
+            utility::epoch::guard guard;
+            table * snapshot = current.load (std::memory_order_acquire);
+            if (!snapshot->consistent())
+                ++ error_count;
+        }
+    }
+};
+
+class writer {
+    std::atomic <table *> & current;
+    pointer_type & owner;
+    std::atomic <bool> & done;
+public:
+    writer (std::atomic <table *> & current, pointer_type & owner,
+        std::atomic <bool> & done)
+    : current (current), owner (owner), done (done) {}
+
+    void operator() () const {
+        std::allocator <table> allocator;
+        for (int value = 1; !done.load (std::memory_order_relaxed); ++ value) {
+            pointer_type old = owner;
+            owner = pointer_type::construct (allocator, value);
+            current.store (owner.get(), std::memory_order_release);
+            old.retire();
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_epoch_threaded) {
+    pointer_type owner = pointer_type::construct (std::allocator <table>(), 0);
+    std::atomic <table *> current (owner.get());
+    std::atomic <bool> done (false);
+
+    boost::thread write_thread ((writer (current, owner, done)));
+    boost::thread_group readers;
+    for (int t = 0; t != reader_num; ++ t)
+        readers.create_thread (reader (current));
+    readers.join_all();
+    done.store (true);
+    // The writer destructs the objects it has retired when it exits.
+    write_thread.join();
+
+    BOOST_CHECK_EQUAL (error_count.load(), 0);
+    BOOST_CHECK_EQUAL (destruct_count.load(), construct_count.load() - 1);
+
+    owner.retire();
+    for (int i = 0; i != 3; ++ i)
+        utility::epoch::collect();
+    BOOST_CHECK_EQUAL (destruct_count.load(), construct_count.load());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,192 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Test that long chains of objects are destructed on the reclaimer thread, and
+compare the time that releasing a long list takes on the releasing thread.
+*/
+
+#define BOOST_TEST_MODULE test_utility_reclaimer_threaded
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include "utility/small_ptr.hpp"
+#include "utility/reclaimer.hpp"
+
+#include <boost/thread/thread.hpp>
+
+static constexpr std::size_t threshold = 1000;
+static constexpr int node_num = 500000;
+
+std::atomic <int> inline_destruct_count (0);
+std::atomic <int> background_destruct_count (0);
+
+/**
+Node in a list, which is destructed in the background if \a background is
+true.
+*/
+template <bool background> struct node;
+
+namespace utility { namespace pointer_policy {
+
+    template <> struct move_recursive_next <node <true>> {
+        typedef destruct_chain_in_background <threshold> destruction;
+        small_ptr <node <true>> && operator() (node <true> * object) const;
+    };
+
+    template <> struct move_recursive_next <node <false>> {
+        small_ptr <node <false>> && operator() (node <false> * object) const;
+    };
+
+}} // namespace utility::pointer_policy
+
+template <bool background> struct node : utility::shared {
+    int value_;
+    utility::small_ptr <node> next_;
+
+    explicit node (int value)
+    : value_ (value), next_ (std::allocator <node>()) {}
+
+    ~node() {
+        if (utility::reclaimer::on_reclaimer_thread())
+            ++ background_destruct_count;
+        else
+            ++ inline_destruct_count;
+    }
+};
+
+inline utility::small_ptr <node <true>> &&
+    utility::pointer_policy::move_recursive_next <node <true>>::operator() (
+        node <true> * object) const
+{ return std::move (object->next_); }
+
+inline utility::small_ptr <node <false>> &&
+    utility::pointer_policy::move_recursive_next <node <false>>::operator() (
+        node <false> * object) const
+{ return std::move (object->next_); }
+
+template <bool background>
+    utility::small_ptr <node <background>> make_list (int length)
+{
+    typedef utility::small_ptr <node <background>> pointer_type;
+    std::allocator <node <background>> allocator;
+    pointer_type first (allocator);
+    for (int i = length - 1; i >= 0; -- i) {
+        pointer_type n = pointer_type::construct (allocator, i);
+        n->next_ = std::move (first);
+        first = std::move (n);
+    }
+    return first;
+}
+
+/// Wait for objects from earlier tests, and reset the counts.
+void reset_counts() {
+    utility::reclaimer::drain();
+    inline_destruct_count = 0;
+    background_destruct_count = 0;
+}
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_reclaimer_threaded)
+
+BOOST_AUTO_TEST_CASE (test_reclaimer_list) {
+    reset_counts();
+    {
+        utility::small_ptr <node <true>> list = make_list <true> (node_num);
+        list = utility::small_ptr <node <true>> (
+            std::allocator <node <true>>());
+        // The first node and the threshold after it are destructed here.
+        BOOST_CHECK_EQUAL (inline_destruct_count.load(), int (threshold) + 1);
+    }
+    utility::reclaimer::drain();
+    BOOST_CHECK_EQUAL (inline_destruct_count.load(), int (threshold) + 1);
+    BOOST_CHECK_EQUAL (background_destruct_count.load(),
+        node_num - int (threshold) - 1);
+
+    // A short list is destructed immediately.
+    reset_counts();
+    {
+        utility::small_ptr <node <true>> list = make_list <true> (10);
+    }
+    BOOST_CHECK_EQUAL (inline_destruct_count.load(), 10);
+    utility::reclaimer::drain();
+    BOOST_CHECK_EQUAL (background_destruct_count.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE (test_reclaimer_shared_tail) {
+    reset_counts();
+    utility::small_ptr <node <true>> list = make_list <true> (node_num);
+    // Keep the second half alive.
+    utility::small_ptr <node <true>> tail = list;
+    for (int i = 0; i != node_num / 2; ++ i)
+        tail = tail->next_;
+    list = tail;
+    utility::reclaimer::drain();
+    BOOST_CHECK_EQUAL (inline_destruct_count.load()
+        + background_destruct_count.load(), node_num / 2);
+    BOOST_CHECK_EQUAL (tail->value_, node_num / 2);
+    BOOST_CHECK_EQUAL (tail.use_count(), 2);
+}
+
+/**
+Release lists from many threads at once, so that the reclaimer thread
+receives work while it is busy.
+*/
+BOOST_AUTO_TEST_CASE (test_reclaimer_threads) {
+    reset_counts();
+    static constexpr int thread_num = 4;
+    static constexpr int list_num = 20;
+    static constexpr int length = 10000;
+    boost::thread_group threads;
+    for (int t = 0; t != thread_num; ++ t)
+        threads.create_thread ([] {
+            for (int l = 0; l != list_num; ++ l)
+                make_list <true> (length);
+        });
+    threads.join_all();
+    utility::reclaimer::drain();
+    BOOST_CHECK_EQUAL (inline_destruct_count.load(),
+        thread_num * list_num * (int (threshold) + 1));
+    BOOST_CHECK_EQUAL (inline_destruct_count.load()
+        + background_destruct_count.load(), thread_num * list_num * length);
+}
+
+/**
+\return The time in milliseconds that releasing \a list takes on this thread.
+*/
+template <bool background>
+    double time_release (utility::small_ptr <node <background>> list)
+{
+    auto start = std::chrono::steady_clock::now();
+    list = utility::small_ptr <node <background>> (
+        std::allocator <node <background>>());
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration <double, std::milli> (end - start).count();
+}
+
+BOOST_AUTO_TEST_CASE (test_reclaimer_latency) {
+    double inline_time = time_release (make_list <false> (node_num));
+    double background_time = time_release (make_list <true> (node_num));
+    utility::reclaimer::drain();
+    std::cout << "Releasing a list of " << node_num << " nodes: "
+        << inline_time << " ms inline, " << background_time
+        << " ms with the reclaimer." << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,180 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Test that a sharded reference count is correct when many threads acquire and
+release references, and when shutdown() is called while they are doing so.
+*/
+
+#define BOOST_TEST_MODULE test_utility_sharded_shared_threaded
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "utility/small_ptr.hpp"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_sharded_shared_threaded)
+
+static constexpr int round_num = 200;
+static constexpr int thread_num = 8;
+static constexpr int copy_num = 5000;
+
+std::atomic <int> destruct_count (0);
+/// The number of times an object was found to be destructed while in use.
+std::atomic <int> dead_use_count (0);
+
+class test_object : public utility::sharded_shared {
+public:
+    /// Is set to false on destruction, to detect use after destruction.
+    std::atomic <bool> alive;
+
+    test_object() : alive (true) {}
+    ~test_object() {
+        alive.store (false);
+        ++ destruct_count;
+    }
+};
+
+typedef utility::small_ptr <test_object> pointer_type;
+
+class user {
+    pointer_type object;
+public:
+    explicit user (pointer_type const & object) : object (object) {}
+
+    void operator() () const {
+        for (int i = 0; i != copy_num; ++ i)
+            pointer_type copy = object;
+    }
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_sharded_shared_threaded) {
+    for (int round = 0; round != round_num; ++ round) {
+        boost::thread_group threads;
+        {
+            pointer_type object = pointer_type::construct (
+                std::allocator <test_object>());
+            for (int t = 0; t != thread_num; ++ t)
+                threads.create_thread (user (object));
+            // Shut down while the other threads are using the object.
+            utility::sharded_shared::shutdown (object.get());
+        }
+        threads.join_all();
+        BOOST_CHECK_EQUAL (destruct_count.load(), round + 1);
+    }
+}
+
+/**
+Queue of pointers, through which references are handed from one thread to
+another.
+*/
+class hand_over {
+    boost::mutex mutex;
+    std::vector <pointer_type> pointers;
+    bool done;
+
+public:
+    hand_over() : done (false) {}
+
+    void push (pointer_type const & pointer) {
+        boost::lock_guard <boost::mutex> lock (mutex);
+        pointers.push_back (pointer);
+    }
+
+    void finish() {
+        boost::lock_guard <boost::mutex> lock (mutex);
+        done = true;
+    }
+
+    /**
+    Take all pointers from the queue.
+    \return false iff the queue is finished and empty.
+    */
+    bool pop_all (std::vector <pointer_type> & result) {
+        boost::lock_guard <boost::mutex> lock (mutex);
+        result.swap (pointers);
+        return !(done && result.empty());
+    }
+};
+
+/// Acquire references in one slot, and hand them to another thread.
+class producer {
+    pointer_type object;
+    hand_over & queue;
+public:
+    producer (pointer_type const & object, hand_over & queue)
+    : object (object), queue (queue) {}
+
+    void operator() () {
+        for (int i = 0; i != copy_num; ++ i)
+            queue.push (object);
+        queue.finish();
+        object = pointer_type (std::allocator <test_object>());
+    }
+};
+
+/// Release references that another thread acquired, in another slot.
+class consumer {
+    hand_over & queue;
+public:
+    explicit consumer (hand_over & queue) : queue (queue) {}
+
+    void operator() () const {
+        std::vector <pointer_type> pointers;
+        while (queue.pop_all (pointers)) {
+            for (pointer_type & pointer : pointers) {
+                if (!pointer->alive.load())
+                    ++ dead_use_count;
+                pointer = pointer_type (std::allocator <test_object>());
+            }
+            pointers.clear();
+        }
+    }
+};
+
+/**
+References are acquired in the slot of one thread and released in the slot of
+another, while shutdown() is collapsing the slots.
+The object must not be destructed before the last reference is released.
+*/
+BOOST_AUTO_TEST_CASE (test_utility_sharded_shared_threaded_hand_over) {
+    static constexpr int pair_num = thread_num / 2;
+    destruct_count = 0;
+    for (int round = 0; round != round_num; ++ round) {
+        boost::thread_group threads;
+        hand_over queues [pair_num];
+        {
+            pointer_type object = pointer_type::construct (
+                std::allocator <test_object>());
+            for (hand_over & queue : queues) {
+                threads.create_thread (producer (object, queue));
+                threads.create_thread (consumer (queue));
+            }
+            utility::sharded_shared::shutdown (object.get());
+        }
+        threads.join_all();
+        BOOST_CHECK_EQUAL (destruct_count.load(), round + 1);
+    }
+    BOOST_CHECK_EQUAL (dead_use_count.load(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
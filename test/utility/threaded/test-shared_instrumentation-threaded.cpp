@@ -0,0 +1,89 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Test that instrumentation counts are combined correctly over threads, and that
+objects destructed by the owner of a biased_shared object, after another
+thread has handed a reference back to it, are counted.
+*/
+
+#define UTILITY_SHARED_INSTRUMENTATION
+
+#define BOOST_TEST_MODULE test_utility_shared_instrumentation_threaded
+#include "utility/test/boost_unit_test.hpp"
+
+#include <string>
+#include <memory>
+
+#include "utility/small_ptr.hpp"
+#include "utility/shared_instrumentation.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_shared_instrumentation_threaded)
+
+struct biased_counted : utility::biased_shared {};
+
+typedef utility::small_ptr <biased_counted> pointer_type;
+
+utility::shared_instrumentation::type_statistics
+    find_statistics (std::string const & name)
+{
+    for (auto const & statistics : utility::shared_instrumentation::snapshot())
+        if (statistics.name
+            == "test_suite_utility_shared_instrumentation_threaded::" + name)
+            return statistics;
+    BOOST_FAIL ("No statistics for " + name);
+    return utility::shared_instrumentation::type_statistics();
+}
+
+/// Copy a pointer and release all references, from another thread.
+class user {
+    pointer_type object;
+public:
+    explicit user (pointer_type const & object) : object (object) {}
+
+    void operator() () {
+        for (int i = 0; i != 10; ++ i)
+            pointer_type copy = object;
+        object = pointer_type (std::allocator <biased_counted>());
+    }
+};
+
+BOOST_AUTO_TEST_CASE (test_shared_instrumentation_biased_hand_back) {
+    {
+        auto object = pointer_type::construct (
+            std::allocator <biased_counted>());
+        boost::thread other ((user (object)));
+        other.join();
+    }
+    // The other thread has handed its reference back to this thread, so the
+    // object is still alive.
+    auto statistics = find_statistics ("biased_counted");
+    BOOST_CHECK_EQUAL (statistics.constructions, 1);
+    BOOST_CHECK_EQUAL (statistics.destructions, 0);
+    BOOST_CHECK_EQUAL (statistics.live, 1);
+
+    utility::biased_shared::merge_queued();
+    statistics = find_statistics ("biased_counted");
+    BOOST_CHECK_EQUAL (statistics.destructions, 1);
+    BOOST_CHECK_EQUAL (statistics.live, 0);
+    // The counts of the other thread, which has exited, are included.
+    BOOST_CHECK_EQUAL (statistics.acquires, statistics.releases);
+    BOOST_CHECK_EQUAL (statistics.acquires, 12);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+/*
+Copyright 2014 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Test that weak_small_ptr::lock() is correct when other threads release the
+last owner at the same time.
+*/
+
+#define BOOST_TEST_MODULE test_utility_weak_small_ptr_threaded
+#include "utility/test/boost_unit_test.hpp"
+
+#include <atomic>
+#include <memory>
+
+#include "utility/weak_small_ptr.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_suite_utility_weak_small_ptr_threaded)
+
+static constexpr int round_num = 200;
+static constexpr int thread_num = 8;
+static constexpr int lock_num = 5000;
+
+std::atomic <int> destruct_count (0);
+std::atomic <int> lock_after_destruct_count (0);
+
+class test_object : public utility::weak_shared {
+public:
+    std::atomic <bool> destructed;
+
+    test_object() : destructed (false) {}
+    ~test_object() {
+        destructed.store (true, std::memory_order_relaxed);
+        ++ destruct_count;
+    }
+};
+
+typedef utility::small_ptr <test_object> pointer_type;
+typedef utility::weak_small_ptr <test_object> weak_pointer_type;
+
+class user {
+    weak_pointer_type object;
+public:
+    explicit user (weak_pointer_type const & object) : object (object) {}
+
+    void operator() () const {
+        for (int i = 0; i != lock_num; ++ i) {
+            pointer_type locked = object.lock();
+            if (locked && locked->destructed.load (std::memory_order_relaxed))
+                ++ lock_after_destruct_count;
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE (test_utility_weak_small_ptr_threaded) {
+    for (int round = 0; round != round_num; ++ round) {
+        boost::thread_group threads;
+        {
+            pointer_type object = pointer_type::construct (
+                std::allocator <test_object>());
+            weak_pointer_type weak (object);
+            for (int t = 0; t != thread_num; ++ t)
+                threads.create_thread (user (weak));
+            // Release the object while the other threads are locking it.
+        }
+        threads.join_all();
+        BOOST_CHECK_EQUAL (destruct_count.load(), round + 1);
+    }
+    BOOST_CHECK_EQUAL (lock_after_destruct_count.load(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()